@@ -32,6 +32,8 @@ using std::ofstream;
 using std::filesystem::path;
 using icu::UnicodeString;
 
+#define FIS_DEFO_BUFFER_SIZE 0x10000 /**< Default size of the read-ahead block used by `FileInputStreamer` (64 KiB). */
+
 namespace waffleoRai_Utils {
 
 /***************************************************************************//**
@@ -197,6 +199,29 @@ public:
 	*/
 	virtual const size_t nextBytes(ubyte* dst, const size_t len);
 
+	/**
+	Borrow a read-only view of up to `len` bytes at the current stream position,
+	directly out of the implementation's internal buffer. The stream position does
+	not move; call `consume()` to advance past bytes that have been used.
+	The view is only valid until the next non-const call on this source.
+	Superclass default implementation provides no view and returns 0, so callers
+	should fall back to `nextBytes()` when fewer bytes than needed are returned.
+	@param span Address to write the pointer to the start of the view to.
+	@param len Maximum number of bytes requested.
+	@return Number of contiguous bytes available at `*span`. May be less than `len`
+	(eg. at a buffer edge or stream end), or zero if borrowing is not supported.
+	*/
+	virtual const size_t peekSpan(const ubyte** span, const size_t /*len*/) { *span = nullptr; return 0; }
+
+	/**
+	Advance the stream position past bytes that were viewed with `peekSpan()`, or
+	discard bytes outright. Default superclass implementation just calls `get()`
+	in a loop.
+	@param len Number of bytes to move forward.
+	@return Number of bytes actually consumed.
+	*/
+	virtual const size_t consume(const size_t len);
+
 	/**
 	Destroy this `DataStreamerSource`. Default superclass destructor
 	is empty, but should be virtually overridden.
@@ -210,6 +235,11 @@ but the stream is allocated and managed by the class internally. This allows
 an instance to store a `path` and file offsets so that it can be reopened
 after closure.
 
+Reads are served from an internal read-ahead block that is refilled with a
+single `read()` on the underlying `ifstream`, so the stream position is tracked
+arithmetically rather than queried from the `ifstream` on every byte. The block
+never extends past the end boundary. Its size can be set with `setBufferSize()`.
+
 The purpose of this class is to provide a virtual interface for file input.
 When the flexibility offered by virtual subclasses is not necessary, using
 `ifstream` directly is likely to be faster.
@@ -227,6 +257,19 @@ private:
 	streampos start_boundary = 0;
 	streampos end_boundary = SIZE_UNKNOWN;
 
+	//Read-ahead block. The ifstream is always positioned at buff_off + (buff_end - buffer).
+	size_t buffer_size = FIS_DEFO_BUFFER_SIZE;
+	ubyte* buffer = nullptr;
+	ubyte* buff_pos = nullptr;
+	ubyte* buff_end = nullptr;
+	streampos buff_off = 0; //Absolute file position of buffer start
+	bool src_dry = false; //Last fill came up short of the end boundary
+
+	const streampos position() const { return buff_off + (buff_pos - buffer); }
+	const bool fillBuffer();
+	void resetBuffer(const streampos abs_pos);
+	void allocBuffer();
+
 public:
 
 	/**
@@ -302,12 +345,7 @@ public:
 	@return The start boundary set for the reader. If successful, return value should
 	match the requested value.
 	*/
-	const streampos setStartBoundary(const streampos position) {
-		if (start_boundary >= 0 && start_boundary < end_boundary) {
-			start_boundary = position;
-		}
-		return start_boundary;
-	}
+	const streampos setStartBoundary(const streampos position);
 
 	/**
 	Set the absolute position in the total file of the end position of this reader.
@@ -318,12 +356,21 @@ public:
 	@return The end boundary set for the reader. If successful, return value should
 	match the requested value.
 	*/
-	const streampos setEndBoundary(const streampos position) {
-		if (end_boundary <= maxsz && end_boundary > start_boundary) {
-			end_boundary = position;
-		}
-		return end_boundary;
-	}
+	const streampos setEndBoundary(const streampos position);
+
+	/**
+	Get the size of the read-ahead block used by this reader.
+	@return Read-ahead block size in bytes.
+	*/
+	const size_t getBufferSize() const { return buffer_size; }
+
+	/**
+	Set the size of the read-ahead block used by this reader. If the stream is
+	open, any buffered data is dropped and the block is reallocated; the stream
+	position is kept.
+	@param size Read-ahead block size in bytes. Values of zero are treated as one byte.
+	*/
+	void setBufferSize(const size_t size);
 
 	const bool isSeekable() const override;
 	const streampos tell() override;
@@ -435,6 +482,8 @@ public:
 	Because the `ifstream` is allocated on the heap when the `FileInputStreamer`
 	is opened, if this stream is not open, this method throws an exception as
 	it cannot return a `null` reference.
+	Note that the `ifstream` is read ahead in blocks, so its position is usually
+	past the position reported by `tell()`.
 	@return Readonly reference to the `ifstream` underlying this stream. 
 	@throws InputException If stream is not open.
 	*/
@@ -471,6 +520,8 @@ public:
 	@throws InputException If stream is not open.
 	*/
 	const size_t nextBytes(ubyte* dst, const size_t len) override;
+	const size_t peekSpan(const ubyte** span, const size_t len) override;
+	const size_t consume(const size_t len) override;
 
 	virtual ~FileInputStreamer() { close(); }
 
@@ -645,6 +696,8 @@ public:
 	const int get() override { return (!is_open || current_pos >= data_end) ? EOF : static_cast<int>(*current_pos++) & 0xff; };
 	const ubyte nextByte() override { return (!is_open || current_pos >= data_end) ? 0xff : *current_pos++; };
 	const size_t nextBytes(ubyte* dst, const size_t len) override;
+	const size_t peekSpan(const ubyte** span, const size_t len) override;
+	const size_t consume(const size_t len) override;
 
 	const size_t remaining() const override { return is_open ? static_cast<size_t>(data_end - current_pos) : 0; };
 	const bool streamEnd() const override { return is_open ? (current_pos >= data_end) : true; };
@@ -671,6 +724,232 @@ public:
 	virtual ~MemInputStreamer() { close(); }
 };
 
+/***************************************************************************//**
+A read-only memory mapping of an entire file. The mapping is created by `open()`
+and released by `close()`. A single `FileMapping` can be shared by any number of
+`MmapInputStreamer` windows, so an archive such as an asset package only needs to
+be mapped once no matter how many of its subfiles are being read.
+
+The mapping must outlive every streamer that references it.
+******************************************************************************/
+class WRCU_DLL_API FileMapping
+{
+
+private:
+	const path sFilePath;
+
+	ubyte* data = nullptr;
+	size_t size = 0;
+	bool is_open = false;
+
+#ifdef _WIN32
+	void* hFile = nullptr;
+	void* hMapping = nullptr;
+#else
+	int fd = -1;
+#endif
+
+public:
+
+	/**
+	Construct a `FileMapping` that references the provided `path`. The file
+	is not mapped until `open()` is called.
+	@param path `std::filesystem::path` instance describing the location of the file to be mapped.
+	*/
+	FileMapping(const path& path) :sFilePath(path) {}
+
+	FileMapping(const FileMapping& other) = delete;
+	FileMapping& operator=(const FileMapping& other) = delete;
+
+	/**
+	Get the file path associated with this mapping.
+	@return `std::filesystem::path` instance describing the mapped file.
+	*/
+	const path& getPath() const { return sFilePath; }
+
+	/**
+	Map the file into memory, read-only. Does nothing if the file is already mapped.
+	@throws InputException If the file cannot be opened or mapped.
+	*/
+	void open();
+
+	/**
+	Unmap the file and release the underlying OS handles.
+	*/
+	void close();
+
+	/**
+	Get whether the file is currently mapped.
+	@return `true` if the mapping is open, `false` if not.
+	*/
+	const bool isOpen() const { return is_open; }
+
+	/**
+	Get a pointer to the start of the mapped file.
+	@return Pointer to mapped data, or `NULL` if not mapped (or if the file is empty).
+	*/
+	const ubyte* getData() const { return data; }
+
+	/**
+	Get the size of the mapped file.
+	@return Size of mapping in bytes. Zero if not mapped.
+	*/
+	const size_t getSize() const { return size; }
+
+	virtual ~FileMapping() { close(); }
+
+};
+
+/***************************************************************************//**
+An implementation of `DataStreamerSource` that reads a file through a read-only
+memory mapping. Byte reads are served straight out of the mapping, so there is
+no per-byte call into the OS or the C++ stream library.
+
+The streamer can either map the file itself (constructed from a path), or act
+as a window into a `FileMapping` owned elsewhere, in which case many streamers
+may share one mapping. Start and end boundaries behave the same way as those
+of `FileInputStreamer`: positions passed to `seek()` and returned by `tell()`
+are relative to the start boundary.
+******************************************************************************/
+class WRCU_DLL_API MmapInputStreamer :public DataStreamerSource
+{
+
+private:
+	FileMapping* mapping;
+	bool own_mapping;
+
+	const ubyte* current_pos = nullptr;
+	const ubyte* window_start = nullptr; //Bookkeeping, for speed.
+	const ubyte* window_end = nullptr;
+	size_t read = 0;
+	bool is_open = false;
+
+	streampos start_boundary = 0;
+	streampos end_boundary = SIZE_UNKNOWN;
+
+	void setWindow(const streampos startOffset, const streampos endOffset);
+
+public:
+
+	/**
+	Construct a `MmapInputStreamer` that will map the file at the provided `path`
+	itself when opened. The mapping is released when the streamer is closed.
+	@param path `std::filesystem::path` instance describing the location of the file to be accessed.
+	*/
+	MmapInputStreamer(const path& path) :mapping(new FileMapping(path)), own_mapping(true) {}
+
+	/**
+	Construct a `MmapInputStreamer` that reads through an existing `FileMapping`.
+	The mapping is opened if it is not already, but it is not closed or freed by this streamer.
+	@param shared_map Mapping to read from. Must outlive this streamer.
+	*/
+	MmapInputStreamer(FileMapping& shared_map) :mapping(&shared_map), own_mapping(false) {}
+
+	MmapInputStreamer(const MmapInputStreamer& other) = delete;
+	MmapInputStreamer& operator=(const MmapInputStreamer& other) = delete;
+
+	/**
+	Get the file path associated with this instance.
+	@return `std::filesystem::path` instance describing this reader's source.
+	*/
+	const path& getPath() const { return mapping->getPath(); }
+
+	/**
+	Get the size of the part of the file visible to this reader.
+	@return The size, in bytes, between the start and end boundaries. If the stream
+	has not been opened yet, this is the size of the full file.
+	*/
+	const size_t fileSize() const;
+
+	const streampos getStartBoundary() const { return start_boundary; }
+	const streampos getEndBoundary() const { return end_boundary; }
+
+	/**
+	Set the absolute position in the total file of the start position of this reader.
+	If the current position is before the new start boundary, it is moved up to it.
+	@param position The position in bytes, relative to the start of the full file,
+	to set as the start boundary.
+	@return The start boundary set for the reader. If successful, return value should
+	match the requested value.
+	*/
+	const streampos setStartBoundary(const streampos position);
+
+	/**
+	Set the absolute position in the total file of the end position of this reader.
+	If the current position is after the new end boundary, it is moved back to it.
+	@param position The position in bytes, relative to the start of the full file,
+	to set as the end boundary.
+	@return The end boundary set for the reader. If successful, return value should
+	match the requested value.
+	*/
+	const streampos setEndBoundary(const streampos position);
+
+	const bool isSeekable() const override { return true; }
+	const streampos tell() override;
+
+	/**
+	Request that the stream be set to a specific position. Position is relative
+	to the start boundary, not the full file.
+	@param pos Position to set stream to, relative to start boundary.
+	@return Position, relative to start boundary, that the stream is at upon return.
+	@throws InputException If position is invalid.
+	*/
+	const streampos seek(const streampos pos) override;
+
+	const bool isOpen() const override { return is_open; }
+
+	const bool streamEnd() const override { return current_pos >= window_end; }
+	const bool remainingToEndKnown() const override { return isOpen(); }
+	const size_t remaining() const override { return isOpen() ? static_cast<size_t>(window_end - current_pos) : SIZE_UNKNOWN; }
+
+	const size_t bytesRead() const { return read; }
+	const bool resetReadCounter() override { read = 0; return true; }
+
+	/**
+	Map the file (if needed) and open the stream over the whole file.
+	@throws InputException If the file cannot be mapped.
+	*/
+	void open() override;
+
+	/**
+	Map the file (if needed) and open the stream at the specified offset.
+	The end boundary is set to the end of the file.
+	@param startOffset Position relative to the start of the full file to open at.
+	@throws InputException If the file cannot be mapped or start offset is invalid.
+	*/
+	void open(const streampos startOffset);
+
+	/**
+	Map the file (if needed) and open a part of it as its own subfile stream.
+	@param startOffset Position relative to the start of the full file to open at.
+	@param len Size in bytes of the subfile.
+	@throws InputException If the file cannot be mapped or either boundary is invalid.
+	*/
+	void open(const streampos startOffset, const size_t len);
+
+	/**
+	Skip a number of bytes in the stream. These bytes are not included
+	in the read counter.
+	@param skip_amt Number of bytes to skip.
+	@return Number of bytes actually skipped.
+	*/
+	const size_t skip(const streampos skip_amt);
+
+	/**
+	Close the stream. If this streamer created its own mapping, the file is unmapped.
+	*/
+	void close() override;
+
+	const int get() override { if (current_pos >= window_end) return EOF; read++; return static_cast<int>(*current_pos++) & 0xff; }
+	const ubyte nextByte() override { if (current_pos >= window_end) return 0xff; read++; return *current_pos++; }
+	const size_t nextBytes(ubyte* dst, const size_t len) override;
+	const size_t peekSpan(const ubyte** span, const size_t len) override;
+	const size_t consume(const size_t len) override;
+
+	virtual ~MmapInputStreamer();
+
+};
+
 }
 
 #endif
@@ -38,6 +38,8 @@ private:
 	void initconv_utf16_ordered();
 	void initconv_utf32_sysordered();
 
+	const uint64_t nextUnsignedValue(const int bCount);
+
 public:
 	DataInputStreamer(DataStreamerSource& src, const Endianness endian):eEndian(endian),iSource(src){}
 
@@ -61,6 +63,14 @@ public:
 
 	const size_t nextBytes(ubyte* dst, const size_t len) { return iSource.nextBytes(dst, len); }
 
+	//Bulk readers. Read n values in one nextBytes call, byte swapping in place only if needed.
+	//Return the number of complete values read. If the source knows its remaining size, a trailing
+	//partial value is left unread; otherwise its bytes are consumed and dropped.
+	const size_t nextUnsignedShorts(uint16_t* dst, const size_t n);
+	const size_t nextUnsigned24s(uint32_t* dst, const size_t n);
+	const size_t nextUnsignedInts(uint32_t* dst, const size_t n);
+	const size_t nextUnsignedLongs(uint64_t* dst, const size_t n);
+
 	void setFreeOnCloseFlag(bool b){flag_free_on_close = b;}
 
 	//String reading
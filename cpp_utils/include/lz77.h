@@ -4,6 +4,14 @@
 #define READ_BUFFER_SIZE 512
 #define WRITE_BUFFER_SIZE 512
 
+#define LZ77_HASH_BITS 16
+#define LZ77_DEFO_CHAIN_DEPTH 1024 //0 means unlimited (exhaustive search)
+#define LZ77_OPT_LOOKAHEAD 8 //Front windows of input LZ_PARSE_OPTIMAL plans over at once
+
+#include <atomic>
+#include <thread>
+#include <utility>
+
 #include "ArrayWindow.h"
 #include "FileStreamer.h"
 
@@ -19,6 +27,81 @@ typedef struct WRCU_DLL_API LZCompRule {
     LZCompRule(uint32_t off, uint32_t sz) { max_offset = off; max_run = sz; }
 } LZCompRule;
 
+typedef struct WRCU_DLL_API LZMatch {
+    uint32_t run = 0;
+    uint32_t offset = 0; //Distance - 1, same as streak_off
+
+    LZMatch() {}
+    LZMatch(uint32_t sz, uint32_t off) { run = sz; offset = off; }
+} LZMatch;
+
+enum LZParseMode {
+    LZ_PARSE_GREEDY, //Longest run at every position
+    LZ_PARSE_LAZY, //Puts out a literal instead if the next position has a longer run
+    LZ_PARSE_OPTIMAL //Cheapest path by encodeCost, planned over LZ77_OPT_LOOKAHEAD front windows at a time
+};
+
+//Hash chain match finder over a flat copy of the back window + lookahead. Runs are capped at the front window size.
+//Positions are absolute input offsets, so nothing has to be fixed up when the buffer slides.
+class WRCU_DLL_API LZMatchFinder {
+
+private:
+    ubyte* buffer;
+    size_t buffer_sz;
+    const ubyte* view; //What searches read. buffer, or the caller's input after attach.
+    size_t attached_len = 0;
+    size_t base = 0; //Absolute position of buffer[0]
+    size_t cur = 0; //Absolute position of the next byte to be encoded
+    size_t end = 0; //One past the last byte loaded
+    size_t ins = 0; //Next position to be added to the chains
+
+    size_t max_dist;
+    size_t max_run; //Front window size
+    u32 max_chain = LZ77_DEFO_CHAIN_DEPTH;
+
+    //Entries are position + 1 so that 0 can mean empty
+    size_t* head;
+    size_t* chain;
+    size_t chain_mask;
+
+    //Most recent occurrence of each 1 and 2 byte prefix. Only allocated if a rule allows runs that short.
+    size_t* last1 = nullptr;
+    size_t* last2 = nullptr;
+    bool rules_checked = false;
+
+    void slide();
+    void insertPending(const size_t pos);
+    const u32 search(const size_t pos, const u32 global_min, const vector<LZCompRule>& rules, size_t* best_dist, vector<LZMatch>* found);
+
+public:
+    LZMatchFinder(size_t back_window_size, size_t front_window_size);
+    LZMatchFinder(const LZMatchFinder& other) = delete;
+    LZMatchFinder& operator=(const LZMatchFinder& other) = delete;
+
+    void putByte(ubyte b);
+    void putBytes(const ubyte* data, size_t len);
+    void advance(size_t amt) { cur += amt; }
+    void reset();
+
+    //Searches data in place instead of copying it in. Starts at pos, with everything up to a back window before it already in the dictionary.
+    void attach(const ubyte* data, size_t len, size_t pos = 0);
+    void loadAhead(size_t ahead) { end = (cur + ahead < attached_len) ? cur + ahead : attached_len; } //Attached only: same lookahead putBytes would give
+
+    //Returns the longest run at the current position (+ ahead) allowed by the rules. Offset is written as distance - 1, like streak_off.
+    const u32 findMatch(const u32 global_min, const vector<LZCompRule>& rules, u32* offset, const size_t ahead = 0);
+
+    //Every run that beats the ones before it, shortest first. Each is the closest offset that reaches that length.
+    const size_t findMatches(const u32 global_min, const vector<LZCompRule>& rules, vector<LZMatch>& out, const size_t ahead = 0);
+
+    void setMaxChainDepth(u32 depth) { max_chain = depth; }
+    const u32 getMaxChainDepth() const { return max_chain; }
+    const size_t getLookaheadSize() const { return end - cur; }
+    const size_t getPosition() const { return cur; }
+    const ubyte getByteAhead(size_t ahead) const { return view[cur + ahead - base]; }
+
+    ~LZMatchFinder();
+};
+
 class WRCU_DLL_API LZ77Decompressor: public DataStreamerSource{
 
 private:
@@ -30,30 +113,69 @@ protected:
     DataStreamerSource& src;
 
     size_t back_win_size;
-    ArrayWindow bwin;
-
-    ArrayWindow rwin; //Read buffer
-    size_t front_win_size;
+    size_t front_win_size; //Most a single command can put out
     size_t read_count = 0;
 
+    //Back window followed by decoded bytes that haven't been read yet, all in one flat buffer
+    ubyte* history;
+    size_t hist_sz;
+    ubyte* hist_p0; //Next byte to be read
+    ubyte* hist_p1; //Next byte to be written
+    bool hist_external = false; //History is pointing at a caller's buffer (decodeInto)
+
     //Default implementation fields
     u32 read_plain = 0;
     u32 backread_count = 0;
     u32 backread_off = 0;
 
+    const bool reserveHistory(size_t amt);
+
     virtual const bool processNextCommand() = 0;
     virtual const uint bufferBlock();
 
+    //Flat version of processNextCommand for decompressBuffer: reads one command from in (avail bytes) and sets the same fields.
+    //Literal bytes are still taken from right after it. Returns bytes of in used, or 0 if there's no whole command left.
+    //Formats that don't override this return -1, and decompressBuffer goes through the stream instead.
+    virtual const int decodeCommand(const ubyte* /*in*/, const size_t /*avail*/) { return -1; }
+
+    const size_t decodeFlat(const ubyte* src, const size_t srclen, ubyte* dst, const size_t dstlen, bool* supported);
+
 public:
     LZ77Decompressor(DataStreamerSource& source, size_t front_window_size, size_t back_window_size):DataStreamerSource(),decomp_size(-1),src(source),
-        back_win_size(back_window_size),bwin(back_window_size),rwin(front_window_size),front_win_size(front_window_size){}
+        back_win_size(back_window_size),front_win_size(front_window_size){
+        hist_sz = (back_window_size << 1) + front_window_size;
+        hist_p0 = hist_p1 = history = (ubyte*)malloc(hist_sz);
+    }
     LZ77Decompressor(DataStreamerSource& source, size_t front_window_size, size_t back_window_size, size_t decompressedSize):DataStreamerSource(),
-        decomp_size(decompressedSize),src(source),back_win_size(back_window_size),bwin(back_window_size),rwin(front_window_size),front_win_size(front_window_size){}
+        decomp_size(decompressedSize),src(source),back_win_size(back_window_size),front_win_size(front_window_size){
+        hist_sz = (back_window_size << 1) + front_window_size;
+        hist_p0 = hist_p1 = history = (ubyte*)malloc(hist_sz);
+    }
 
     DataStreamerSource& getSource(){return src;}
 
     const int get() override;
     const ubyte nextByte() override;
+    const size_t nextBytes(ubyte* dst, const size_t len) override;
+    const size_t peekSpan(const ubyte** span, const size_t len) override;
+    const size_t consume(const size_t len) override;
+
+    //Decodes straight into dst, using it as the back window (the last front window's worth goes through the normal buffer).
+    //Only from the start of the stream; otherwise the same as nextBytes.
+    const size_t decodeInto(ubyte* dst, const size_t len);
+
+    //Whole-buffer decode. T is the format's subclass, built over src with the trailing constructor arguments. Returns bytes written.
+    //Works straight on src and dst if T implements decodeCommand, otherwise decodes through the stream with decodeInto.
+    template<class T, typename... Args>
+    static const size_t decompressBuffer(const ubyte* src, const size_t srclen, ubyte* dst, const size_t dstlen, Args&&... args){
+        MemInputStreamer input(src, srclen);
+        input.open();
+        T dec(input, std::forward<Args>(args)...);
+        bool flat = true;
+        const size_t ct = dec.decodeFlat(src, srclen, dst, dstlen, &flat);
+        if (flat) return ct;
+        return dec.decodeInto(dst, dstlen);
+    }
 
     const bool remainingToEndKnown() const override;
 	const size_t remaining() const override;
@@ -64,7 +186,7 @@ public:
 	virtual void open() override {}
 	void close() override;
 
-	virtual ~LZ77Decompressor(){};
+	virtual ~LZ77Decompressor(){free(history);};
 
 };
 
@@ -91,19 +213,142 @@ protected:
     u32 streak_off = 0;
 
     u32 global_streak_min = 1;
-    vector<LZCompRule> streak_mins = vector<LZCompRule>(); //TODO
+    u32 global_streak_max = 0; //Longest run encodeToWriteBuffer can take in one block. 0 means the front window size.
+    vector<LZCompRule> streak_mins = vector<LZCompRule>(); //Sorted by max_offset. Runs at offsets >= max_offset need at least max_run bytes.
+
+    LZMatchFinder finder; //Mirrors bwin + fwin, plus extra lookahead for LZ_PARSE_OPTIMAL
+
+    LZParseMode parse_mode = LZ_PARSE_GREEDY;
+
+    //Lazy: run already found for the byte after a deferred match
+    size_t lazy_pos = 0;
+    LZMatch lazy_match;
+    bool lazy_valid = false;
+
+    //Optimal: blocks picked for the current lookahead, and the position the next one starts at
+    vector<LZMatch> plan;
+    size_t plan_idx = 0;
+    size_t plan_pos = 0;
+    vector<LZMatch> plan_found;
+    vector<LZMatch> plan_edge; //Cheapest block ending at each byte
+    vector<u64> plan_cost;
+
+    void parseLazy();
+    void parseOptimal();
+    void buildPlan();
+
+    const bool encodeNextBlock();
 
     virtual void processNextByte(); //Writes to streak_count and streak_off
     virtual const int encodeToWriteBuffer() = 0; //Uses streak_count and streak_off and front window to encode next block. Returns # bytes read.
 
+    //Flat version of encodeToWriteBuffer for compressBuffer: front is the input at the current position. Writes the block to out (outcap bytes free),
+    //sets written, and returns # bytes read, or 0 if the block doesn't fit. Formats that don't override this return -1, and compressBuffer streams instead.
+    virtual const int encodeToBuffer(const ubyte* /*front*/, ubyte* /*out*/, const size_t /*outcap*/, size_t* /*written*/) { return -1; }
+
+    //Encodes data from start to len. Anything before start is only there to be referenced, like primeDictionary.
+    const size_t encodeFlat(const ubyte* data, const size_t start, const size_t len, ubyte* dst, const size_t dstcap, bool* supported);
+
+    //Relative size (eg. bits) of the block encodeToWriteBuffer would write for this run/offset. Run 0 is a literal. Only used by LZ_PARSE_OPTIMAL.
+    //Default is 1 flag bit + 8 bits for a literal, 1 + 16 bits for a back reference.
+    virtual const u32 encodeCost(const u32 run, const u32 /*offset*/) const { return run > 0 ? 17 : 9; }
+
 public:
     LZ77Compressor(DataStreamerSource& data_source, size_t front_window_size, size_t back_window_size):DataStreamerSource(),src(data_source),
-        back_win_size(back_window_size), bwin(back_window_size), fwin(front_window_size), front_win_size(front_window_size), write_buffer(WRITE_BUFFER_SIZE){}
+        back_win_size(back_window_size), bwin(back_window_size), fwin(front_window_size), front_win_size(front_window_size), write_buffer(WRITE_BUFFER_SIZE),
+        finder(back_window_size, front_window_size){}
 
     DataStreamerSource& getSource() { return src; }
 
+    void setMaxChainDepth(u32 depth) { finder.setMaxChainDepth(depth); } //Candidates checked per position. 0 checks every match in the window.
+    void primeDictionary(const ubyte* data, size_t len); //Loads data as if it had already been encoded, so runs can reach back into it. Before the first read only.
+    void setParseMode(LZParseMode mode) { parse_mode = mode; }
+    const LZParseMode getParseMode() const { return parse_mode; }
+
     const int get() override;
     const ubyte nextByte() override;
+    const size_t nextBytes(ubyte* dst, const size_t len) override;
+
+    //Whole-buffer encode. T is the format's subclass, built over src with the trailing constructor arguments.
+    //Matches are found in src in place and blocks written straight to dst if T implements encodeToBuffer, otherwise it runs the stream encoder.
+    //Returns bytes written, or 0 if the output didn't fit in dstcap.
+    template<class T, typename... Args>
+    static const size_t compressBuffer(const ubyte* src, const size_t srclen, ubyte* dst, const size_t dstcap, Args... args){
+        MemInputStreamer input(src, srclen);
+        input.open();
+        bool flat = true;
+        {
+            T enc(input, args...);
+            const size_t ct = enc.encodeFlat(src, 0, srclen, dst, dstcap, &flat);
+            if (flat) return ct;
+        }
+        T enc(input, args...);
+        const size_t ct = enc.nextBytes(dst, dstcap);
+        return enc.streamEnd() ? ct : 0;
+    }
+
+    //Splits src into block_size pieces, compresses them on worker threads, and writes the outputs to dst in order.
+    //If prime is set, each block's encoder is primed with the input before it, so runs can still reach across blocks.
+    //The format has to decode its block outputs back to back as one stream. Returns bytes written, or 0 if they didn't fit in dstcap.
+    template<class T, typename... Args>
+    static const size_t compressBlocks(const ubyte* src, const size_t srclen, ubyte* dst, const size_t dstcap, const size_t block_size, const bool prime, int workers, Args... args){
+        if (block_size == 0) return 0;
+        const size_t bcount = (srclen + block_size - 1) / block_size;
+        if (workers <= 0) workers = (int)std::thread::hardware_concurrency();
+        if (workers <= 0) workers = 1;
+        if ((size_t)workers > bcount) workers = (int)bcount;
+
+        vector<vector<ubyte>> outputs(bcount);
+        std::atomic<size_t> next(0);
+        auto work = [&]() {
+            size_t b;
+            while ((b = next++) < bcount) {
+                const size_t off = b * block_size;
+                const size_t len = (srclen - off) < block_size ? (srclen - off) : block_size;
+                MemInputStreamer input(src + off, len);
+                input.open();
+                vector<ubyte>& out = outputs[b];
+
+                //Flat first, in place over src. Falls back to the stream if T can't, or the block grew past the guess.
+                out.resize(len + (len >> 1) + 64);
+                bool flat = true;
+                size_t ct = 0;
+                {
+                    T fenc(input, args...);
+                    if (prime) ct = fenc.encodeFlat(src, off, off + len, out.data(), out.size(), &flat);
+                    else ct = fenc.encodeFlat(src + off, 0, len, out.data(), out.size(), &flat);
+                }
+                if (flat && (ct > 0 || len == 0)) {
+                    out.resize(ct);
+                    continue;
+                }
+
+                T enc(input, args...);
+                if (prime && off > 0) enc.primeDictionary(src, off);
+                ct = 0;
+                while (true) {
+                    out.resize(ct + READ_BUFFER_SIZE);
+                    const size_t got = enc.nextBytes(out.data() + ct, READ_BUFFER_SIZE);
+                    ct += got;
+                    if (got == 0 || enc.streamEnd()) break;
+                }
+                out.resize(ct);
+            }
+        };
+
+        vector<std::thread> threads;
+        for (int i = 1; i < workers; i++) threads.push_back(std::thread(work));
+        work();
+        for (std::thread& t : threads) t.join();
+
+        size_t total = 0;
+        for (const vector<ubyte>& out : outputs) {
+            if (out.size() > dstcap - total) return 0;
+            memcpy(dst + total, out.data(), out.size());
+            total += out.size();
+        }
+        return total;
+    }
 
     const bool remainingToEndKnown() const override { return false; }
     const size_t remaining() const override;
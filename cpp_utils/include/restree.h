@@ -11,12 +11,20 @@
 #include <vector>
 #include <list>
 #include <map>
+#include <memory>
+#include <algorithm>
 #include <stdexcept>
 #include <cstddef>
 #include <filesystem> //Need C++ 17 !
 
 #include "wr_cpp_utils.h"
 
+/*
+ * Build option: define WRCU_RESMAP_HASHED to back ResourceMap lookups with an open-addressing
+ * hash index instead of the sorted key array. Exact key lookups become O(1), but cards are then
+ * stored in insertion order and type/group range queries fall back to a linear scan.
+ */
+
 using std::map;
 using std::vector;
 using std::list;
@@ -50,6 +58,27 @@ public:
 
 } ResourceKey;
 
+}
+
+namespace std{
+
+template<> struct hash<waffleoRai_Utils::ResourceKey>{
+	size_t operator()(const waffleoRai_Utils::ResourceKey& key) const noexcept{
+		//Fold the 16 byte key into 64 bits, then finish with a murmur3 style mix so low bits are usable as a bucket index
+		u64 h = key.instanceID ^ ((static_cast<u64>(key.typeID) << 32) | key.groupID) * 0x9e3779b97f4a7c15ULL;
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+		return static_cast<size_t>(h);
+	}
+};
+
+}
+
+namespace waffleoRai_Utils{
+
 /*--- Resource Card ---*/
 
 class WRCU_DLL_API ResourceCard {
@@ -68,7 +97,8 @@ public:
 	ResourceCard() :key(), name("") {};
 	ResourceCard(const ResourceKey& rkey, const path& path) :key(rkey), filepath(&path), name("") {};
 	ResourceCard(const u32 type, const u32 group, const u64 instance, const path& path) :key(type, group, instance), filepath(&path) {};
-	ResourceCard(const ResourceCard& other) :key(other.key), filepath(other.filepath), offset(other.offset), rawSize(other.rawSize), decompSize(other.decompSize), compressed(other.compressed) {};
+	ResourceCard(const ResourceCard& other) :key(other.key), filepath(other.filepath), offset(other.offset), rawSize(other.rawSize), decompSize(other.decompSize),
+		misc_flags(other.misc_flags), compressed(other.compressed), isValid(other.isValid), name(other.name) {};
 
 	ResourceCard& operator=(const ResourceCard& other);
 	bool operator==(const ResourceCard& other) const;
@@ -83,7 +113,7 @@ public:
 
 /*--- Resource Map ---*/
 
-typedef std::map<ResourceKey, ResourceCard>::const_iterator ResMapItr;
+typedef std::vector<ResourceCard*>::const_iterator ResMapItr;
 
 class WRCU_DLL_API NoResourceCardException:public exception
 {
@@ -105,8 +135,10 @@ class WRCU_DLL_API PathTable{
 
 private:
 	vector<path> str_vec;
+	path base_path; //If set, relative paths are resolved against this as they are added
 
 	void init_core(const size_t init_alloc);
+	const path resolve(const path& p) const;
 
 public:
 	PathTable() :str_vec() { init_core(4); }
@@ -115,6 +147,10 @@ public:
 	const size_t getSize() { return str_vec.size(); }
 	const path& getPathAtIndex(const int idx);
 
+	//Resolves relative paths already in the table in place, so existing references stay valid
+	void setBasePath(const path& base);
+	const path& getBasePath() const { return base_path; }
+
 	const int addPath(const path& p);
 	const int findPath(const path& p);
 
@@ -124,13 +160,81 @@ public:
 
 };
 
+/*
+ * Robin Hood hash index mapping keys to positions in an external key array.
+ * Each slot holds the key position and its hash, so probes only touch the key array on a hash match.
+ */
+class WRCU_DLL_API ResourceKeyIndex{
+
+private:
+	static const u32 EMPTY_SLOT = ~0U;
+
+	typedef struct Slot{
+		u32 idx = EMPTY_SLOT;
+		u32 hash = 0;
+	} Slot;
+
+	vector<Slot> slots;
+	size_t mask = 0;
+	size_t count = 0;
+
+	static const u32 hashKey(const ResourceKey& key) { return static_cast<u32>(std::hash<ResourceKey>()(key)); }
+	const size_t probeDistance(const size_t pos, const u32 hash) const { return (pos - (hash & mask)) & mask; }
+	const size_t findSlot(const ResourceKey& key, const vector<ResourceKey>& keys) const;
+	void place(Slot slot);
+	void rehash(const size_t slot_count);
+
+public:
+	ResourceKeyIndex():slots(){};
+
+	const size_t find(const ResourceKey& key, const vector<ResourceKey>& keys) const;
+	void insert(const ResourceKey& key, const size_t idx);
+	void erase(const ResourceKey& key, const vector<ResourceKey>& keys);
+	void remap(const ResourceKey& key, const vector<ResourceKey>& keys, const size_t new_idx);
+	void reserve(const size_t key_count);
+	void clear();
+	const size_t size() const { return count; }
+
+};
+
+/*
+ * Cards are kept in a flat index sorted by key: one contiguous array of keys that is
+ * binary searched, and a parallel array of card pointers. Cards of one type (or one type and group)
+ * are therefore adjacent in the index, so range queries are a single contiguous scan.
+ *
+ * The cards themselves live in fixed size blocks that are never moved or freed until the map
+ * is cleared, so (as with the old std::map backend) a pointer or reference to a card stays valid
+ * until that card is removed. Only the index is reordered on insertion. For loading large tables,
+ * use beginBulkInsert/bulkAppend/endBulkInsert so the index is sorted once instead of per card.
+ *
+ * With WRCU_RESMAP_HASHED, the index is instead kept in insertion order and looked up
+ * through a ResourceKeyIndex. Removal moves the last index entry into the freed position.
+ */
 class WRCU_DLL_API ResourceMap{
 
 private:
-	map<ResourceKey, ResourceCard> rMap;
+	static const size_t CARD_BLOCK_SIZE = 256;
+
+	vector<ResourceKey> rKeys;
+	vector<ResourceCard*> rCards; //Parallel to rKeys, points into card_blocks
+
+	vector<std::unique_ptr<ResourceCard[]>> card_blocks;
+	size_t card_slots_used = 0;
+	vector<ResourceCard*> free_cards; //Slots of removed cards, reused before taking a new one
+
+	size_t bulk_start = SIZE_UNKNOWN; //Index of first unsorted card while a bulk insert is in progress
+#ifdef WRCU_RESMAP_HASHED
+	ResourceKeyIndex rIndex;
+#endif
+
+	const size_t lowerBound(const ResourceKey& key) const;
+	const size_t findIndex(const ResourceKey& key) const;
+	ResourceCard* insertAt(const size_t idx, const ResourceCard& card);
+	ResourceCard* allocCard();
+	void freeCard(ResourceCard* card);
 
 public:
-	ResourceMap():rMap(){};
+	ResourceMap():rKeys(),rCards(){};
 	ResourceCard& getCard(u32 type, u32 group, u64 instance);
 	ResourceCard& getCard(ResourceKey& key);
 
@@ -141,15 +245,24 @@ public:
 
 	const int countCards() const;
 
-	ResMapItr cbegin() const { return rMap.cbegin(); };
-	ResMapItr cend() const { return rMap.cend(); };
-	map<ResourceKey, ResourceCard>& getMapView() { return rMap; };
+	ResMapItr cbegin() const { return rCards.cbegin(); };
+	ResMapItr cend() const { return rCards.cend(); };
+	const vector<ResourceCard*>& getCardView() const { return rCards; };
 
 	const bool hasCard(const ResourceKey& key) const;
+	ResourceCard* findCard(const ResourceKey& key); //Like getCard, but returns nullptr instead of throwing
+	const ResourceCard* findCard(const ResourceKey& key) const;
 	ResourceCard* addCard(const ResourceKey& key);
 	ResourceCard* addCard(const ResourceCard& card, const bool allow_overwrite);
 	const bool removeCard(const ResourceKey& key);
 	void clearCards();
+	void reserve(const size_t count);
+
+	//Bulk loading. Cards appended between begin and end are not searchable until endBulkInsert sorts them in.
+	void beginBulkInsert(const size_t count);
+	ResourceCard& bulkAppend(const ResourceKey& key);
+	ResourceCard& bulkAppend(const ResourceCard& card);
+	void endBulkInsert(const bool allow_overwrite);
 
 	const int copyIntoMap(ResourceMap& target, list<ResourceCard*>& output_list) const;
 
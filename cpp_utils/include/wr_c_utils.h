@@ -255,6 +255,30 @@ extern "C" {
 	*/
 	WRCU_DLL_API void WRCU_CDECL wrcu_reverseBytes(uint8_t* ptr, const int nbytes);
 
+	/**
+	Reverse the byte order of each element in an array of 16-bit values, in place.
+	Uses a SIMD byte shuffle when one is available (SSSE3, detected at runtime, or NEON).
+	@param ptr Pointer to the start of the array. Does not need to be aligned.
+	@param count Number of 16-bit elements in the array.
+	*/
+	WRCU_DLL_API void WRCU_CDECL wrcu_reverseBytes16Array(uint16_t* ptr, const size_t count);
+
+	/**
+	Reverse the byte order of each element in an array of 32-bit values, in place.
+	Uses a SIMD byte shuffle when one is available (SSSE3, detected at runtime, or NEON).
+	@param ptr Pointer to the start of the array. Does not need to be aligned.
+	@param count Number of 32-bit elements in the array.
+	*/
+	WRCU_DLL_API void WRCU_CDECL wrcu_reverseBytes32Array(uint32_t* ptr, const size_t count);
+
+	/**
+	Reverse the byte order of each element in an array of 64-bit values, in place.
+	Uses a SIMD byte shuffle when one is available (SSSE3, detected at runtime, or NEON).
+	@param ptr Pointer to the start of the array. Does not need to be aligned.
+	@param count Number of 64-bit elements in the array.
+	*/
+	WRCU_DLL_API void WRCU_CDECL wrcu_reverseBytes64Array(uint64_t* ptr, const size_t count);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,5 +1,14 @@
 #include "FileInput.h"
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 using std::filesystem::filesystem_error;
 
 namespace waffleoRai_Utils {
@@ -20,6 +29,14 @@ namespace waffleoRai_Utils {
 		return static_cast<size_t>(pos - dst);
 	}
 
+	const size_t DataStreamerSource::consume(const size_t len) {
+		size_t i;
+		for (i = 0; i < len; i++) {
+			if (get() == EOF) return i;
+		}
+		return len;
+	}
+
 	const bool DataStreamerSource::isSeekable() const {
 		return false;
 	}
@@ -36,6 +53,38 @@ namespace waffleoRai_Utils {
 
 #define FIS_ISOPEN (oOpenStream != NULL && oOpenStream->is_open())
 
+	void FileInputStreamer::allocBuffer() {
+		if (!buffer) buffer = (ubyte*)malloc(buffer_size);
+		if (!buffer) throw InputException("waffleoRai_Utils::FileInputStreamer::allocBuffer", "Failed to allocate read buffer!");
+	}
+
+	void FileInputStreamer::resetBuffer(const streampos abs_pos) {
+		//Drops buffered data and moves the underlying stream to the requested position
+		buff_off = abs_pos;
+		buff_pos = buff_end = buffer;
+		src_dry = false;
+		oOpenStream->clear();
+		oOpenStream->seekg(abs_pos);
+	}
+
+	const bool FileInputStreamer::fillBuffer() {
+		//Only called once buffer has been consumed, so the stream is sitting at the next unread byte
+		streampos pos = position();
+		if (pos >= end_boundary || src_dry) return false;
+		size_t amt = buffer_size;
+		size_t left = static_cast<size_t>(end_boundary - pos);
+		if (left < amt) amt = left;
+
+		oOpenStream->read((char*)buffer, amt);
+		size_t got = static_cast<size_t>(oOpenStream->gcount());
+		if (got < amt) src_dry = true;
+
+		buff_off = pos;
+		buff_pos = buffer;
+		buff_end = buffer + got;
+		return (got > 0);
+	}
+
 	const size_t FileInputStreamer::fileSize() const {
 		//https://stackoverflow.com/questions/5840148/how-can-i-get-a-files-size-in-c
 		/*struct stat stat_buf;
@@ -50,10 +99,50 @@ namespace waffleoRai_Utils {
 		catch (filesystem_error& x) { return SIZE_UNKNOWN; }
 	}
 
+	const streampos FileInputStreamer::setStartBoundary(const streampos position) {
+		if (position >= 0 && position < end_boundary) {
+			start_boundary = position;
+			if (FIS_ISOPEN && this->position() < position) resetBuffer(position);
+		}
+		return start_boundary;
+	}
+
+	const streampos FileInputStreamer::setEndBoundary(const streampos position) {
+		if (position > start_boundary && (maxsz == SIZE_UNKNOWN || position <= static_cast<streampos>(maxsz))) {
+			end_boundary = position;
+			if (FIS_ISOPEN) {
+				//Drop anything that was read ahead past the new end.
+				streampos bend = buff_off + (buff_end - buffer);
+				if (bend > position) {
+					streampos pos = this->position();
+					resetBuffer(pos < position ? pos : position);
+				}
+				else src_dry = false;
+			}
+		}
+		return end_boundary;
+	}
+
+	void FileInputStreamer::setBufferSize(const size_t size) {
+		const size_t nsize = size > 0 ? size : 1;
+		if (nsize == buffer_size) return;
+		if (!FIS_ISOPEN) {
+			buffer_size = nsize;
+			return;
+		}
+		streampos pos = position();
+		free(buffer);
+		buffer = nullptr;
+		buffer_size = nsize;
+		allocBuffer();
+		resetBuffer(pos);
+	}
+
 	const bool FileInputStreamer::streamEnd() const {
 		if (oOpenStream == NULL) return true;
 		if (!oOpenStream->is_open()) return true;
-		return (oOpenStream->eof() || (oOpenStream->tellg() >= end_boundary));
+		if (buff_pos < buff_end) return false;
+		return (src_dry || (position() >= end_boundary));
 	}
 
 	const bool FileInputStreamer::remainingToEndKnown() const {
@@ -65,7 +154,7 @@ namespace waffleoRai_Utils {
 	const size_t FileInputStreamer::remaining() const {
 		if (!FIS_ISOPEN) return SIZE_UNKNOWN;
 		if (end_boundary == SIZE_UNKNOWN) return SIZE_UNKNOWN;
-		streampos tell = oOpenStream->tellg();
+		streampos tell = position();
 		if(tell > end_boundary) return SIZE_UNKNOWN;
 		size_t diff = static_cast<size_t>(end_boundary - tell);
 		return diff;
@@ -81,8 +170,11 @@ namespace waffleoRai_Utils {
 		if (FIS_ISOPEN) return;
 		read = 0;
 		end_boundary = maxsz = fileSize();
+		start_boundary = 0;
 		oOpenStream = new ifstream(sFilePath, ifstream::in | ifstream::binary);
 		if (oOpenStream->fail()) throw InputException("waffleoRai_Utils::FileInputStreamer::open", "Failed to open stream!");
+		allocBuffer();
+		resetBuffer(0);
 	}
 
 	void FileInputStreamer::open(const streampos startOffset) {
@@ -94,6 +186,8 @@ namespace waffleoRai_Utils {
 		oOpenStream->seekg(startOffset);
 		if (oOpenStream->fail()) throw InputException("waffleoRai_Utils::FileInputStreamer::open", "Failed to open stream!");
 		start_boundary = startOffset;
+		allocBuffer();
+		resetBuffer(startOffset);
 	}
 
 	void FileInputStreamer::open(const streampos startOffset, const size_t len) {
@@ -107,17 +201,21 @@ namespace waffleoRai_Utils {
 		oOpenStream = new ifstream(sFilePath, ifstream::in | ifstream::binary);
 		oOpenStream->seekg(startOffset);
 		if (oOpenStream->fail()) throw InputException("waffleoRai_Utils::FileInputStreamer::open", "Failed to open stream!");
+		allocBuffer();
+		resetBuffer(startOffset);
 	}
 
 	const size_t FileInputStreamer::skip(const streampos skip_amt) {
 		if (!FIS_ISOPEN) return SIZE_UNKNOWN;
-		streampos pos = oOpenStream->tellg();
+		streampos pos = position();
 		streampos trg = pos + skip_amt;
 		if (trg > end_boundary) {
 			trg = end_boundary;
 		}
-		oOpenStream->seekg(trg);
-		return static_cast<size_t>(oOpenStream->tellg() - pos);
+		streampos bend = buff_off + (buff_end - buffer);
+		if (trg >= buff_off && trg <= bend) buff_pos = buffer + static_cast<size_t>(trg - buff_off);
+		else resetBuffer(trg);
+		return static_cast<size_t>(trg - pos);
 	}
 
 	const bool FileInputStreamer::isSeekable() const { return true; }
@@ -126,13 +224,16 @@ namespace waffleoRai_Utils {
 		if (!FIS_ISOPEN) return SIZE_UNKNOWN;
 		streampos trg = pos + start_boundary;
 		if (trg > end_boundary) throw InputException("waffleoRai_Utils::FileInputStreamer::seek", "Seek position is invalid!");
-		oOpenStream->seekg(trg);
-		return oOpenStream->tellg() - start_boundary;
+		//Stay inside the current block if we can
+		streampos bend = buff_off + (buff_end - buffer);
+		if (trg >= buff_off && trg <= bend) buff_pos = buffer + static_cast<size_t>(trg - buff_off);
+		else resetBuffer(trg);
+		return position() - start_boundary;
 	}
 
 	const streampos FileInputStreamer::tell() {
 		if (!FIS_ISOPEN) return SIZE_UNKNOWN;
-		return oOpenStream->tellg() - start_boundary;
+		return position() - start_boundary;
 	}
 
 	void FileInputStreamer::close() {
@@ -142,41 +243,97 @@ namespace waffleoRai_Utils {
 			delete oOpenStream;
 			oOpenStream = NULL;
 		}
+		if (buffer) {
+			free(buffer);
+			buffer = buff_pos = buff_end = NULL;
+		}
 	}
 
 	const ubyte FileInputStreamer::nextByte() {
+		if (buff_pos < buff_end) {
+			read++;
+			return *buff_pos++;
+		}
 		if (!FIS_ISOPEN) throw InputException("waffleoRai_Utils::FileInputStreamer::nextByte", "Failed to retrieve next byte - stream is not open!");
-		if (oOpenStream->tellg() >= end_boundary) return (ubyte)0xff;
-		int b = oOpenStream->get();
-		//if(oOpenStream->fail()) throw InputException("waffleoRai_Utils::FileInputStreamer::nextByte","Failed to retrieve next byte!");
+		if (!fillBuffer()) return (ubyte)0xff;
 		read++;
-		return (ubyte)b;
+		return *buff_pos++;
 	}
 
 	const int FileInputStreamer::get() {
+		if (buff_pos < buff_end) {
+			read++;
+			return static_cast<int>(*buff_pos++) & 0xff;
+		}
 		if (!FIS_ISOPEN) throw InputException("waffleoRai_Utils::FileInputStreamer::get", "Failed to retrieve next byte - stream is not open!");
-		if (oOpenStream->tellg() >= end_boundary) return EOF;
-		int b = oOpenStream->get();
+		if (!fillBuffer()) return EOF;
 		read++;
-		return b;
+		return static_cast<int>(*buff_pos++) & 0xff;
 	}
 
 	const size_t FileInputStreamer::nextBytes(ubyte* dst, const size_t len) {
 		if (!FIS_ISOPEN) throw InputException("waffleoRai_Utils::FileInputStreamer::nextBytes", "Failed to retrieve data - stream is not open!");
-		size_t readamt = len;
-		streampos stpos = oOpenStream->tellg();
-		streampos trg = stpos + static_cast<streampos>(readamt);
-		if (trg > end_boundary) {
-			trg = end_boundary;
-			readamt = static_cast<size_t>(trg - stpos);
+		size_t readamt = 0;
+
+		//Drain what's already buffered
+		size_t amt = static_cast<size_t>(buff_end - buff_pos);
+		if (amt > len) amt = len;
+		if (amt > 0) {
+			memcpy(dst, buff_pos, amt);
+			buff_pos += amt;
+			readamt += amt;
 		}
-		oOpenStream->read((char*)dst, readamt);
-		streampos edpos = oOpenStream->tellg();
-		readamt = static_cast<size_t>(edpos - stpos);
+
+		//Large requests go straight to the destination, small ones through a block refill
+		while (readamt < len) {
+			size_t want = len - readamt;
+			if (want >= buffer_size) {
+				streampos pos = position();
+				if (pos >= end_boundary || src_dry) break;
+				size_t left = static_cast<size_t>(end_boundary - pos);
+				if (want > left) want = left;
+				oOpenStream->read((char*)(dst + readamt), want);
+				size_t got = static_cast<size_t>(oOpenStream->gcount());
+				if (got < want) src_dry = true;
+				buff_off = pos + static_cast<std::streamoff>(got);
+				buff_pos = buff_end = buffer;
+				readamt += got;
+				if (got < want) break;
+			}
+			else {
+				if (!fillBuffer()) break;
+				amt = static_cast<size_t>(buff_end - buff_pos);
+				if (amt > want) amt = want;
+				memcpy(dst + readamt, buff_pos, amt);
+				buff_pos += amt;
+				readamt += amt;
+			}
+		}
+
 		read += readamt;
 		return readamt;
 	}
 
+	const size_t FileInputStreamer::peekSpan(const ubyte** span, const size_t len) {
+		if (buff_pos >= buff_end && FIS_ISOPEN) fillBuffer();
+		*span = buff_pos;
+		size_t avail = static_cast<size_t>(buff_end - buff_pos);
+		return len < avail ? len : avail;
+	}
+
+	const size_t FileInputStreamer::consume(const size_t len) {
+		if (!FIS_ISOPEN) return 0;
+		size_t avail = static_cast<size_t>(buff_end - buff_pos);
+		if (len <= avail) {
+			buff_pos += len;
+			read += len;
+			return len;
+		}
+		size_t ct = skip(static_cast<streampos>(len));
+		read += ct;
+		return ct;
+	}
+
 	/*----- ifstreamer -----*/
 
 	void ifstreamer::open() {} //Does nothing. It assumes that you passed it an open stream.
@@ -293,4 +450,219 @@ namespace waffleoRai_Utils {
 		return cpyamt;
 	}
 
+	const size_t MemInputStreamer::peekSpan(const ubyte** span, const size_t len) {
+		*span = current_pos;
+		if (!is_open || !data) return 0;
+		size_t avail = static_cast<size_t>(data_end - current_pos);
+		return len < avail ? len : avail;
+	}
+
+	const size_t MemInputStreamer::consume(const size_t len) {
+		if (!is_open || !data) return 0;
+		size_t avail = static_cast<size_t>(data_end - current_pos);
+		size_t amt = len < avail ? len : avail;
+		current_pos += amt;
+		return amt;
+	}
+
+	/*----- FileMapping -----*/
+
+	void FileMapping::open() {
+		if (is_open) return;
+#ifdef _WIN32
+		HANDLE fh = CreateFileW(sFilePath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (fh == INVALID_HANDLE_VALUE) throw InputException("waffleoRai_Utils::FileMapping::open", "Failed to open file!");
+		LARGE_INTEGER fsz;
+		if (!GetFileSizeEx(fh, &fsz)) {
+			CloseHandle(fh);
+			throw InputException("waffleoRai_Utils::FileMapping::open", "Failed to retrieve file size!");
+		}
+		hFile = fh;
+		size = static_cast<size_t>(fsz.QuadPart);
+		if (size > 0) {
+			HANDLE mh = CreateFileMappingW(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mh == NULL) {
+				close();
+				throw InputException("waffleoRai_Utils::FileMapping::open", "Failed to map file!");
+			}
+			hMapping = mh;
+			data = (ubyte*)MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+			if (!data) {
+				close();
+				throw InputException("waffleoRai_Utils::FileMapping::open", "Failed to map file!");
+			}
+		}
+#else
+		fd = ::open(sFilePath.c_str(), O_RDONLY);
+		if (fd < 0) throw InputException("waffleoRai_Utils::FileMapping::open", "Failed to open file!");
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			close();
+			throw InputException("waffleoRai_Utils::FileMapping::open", "Failed to retrieve file size!");
+		}
+		size = static_cast<size_t>(st.st_size);
+		if (size > 0) {
+			//mmap of a zero length file fails, so that case is left as an empty, unmapped file.
+			void* ptr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (ptr == MAP_FAILED) {
+				close();
+				throw InputException("waffleoRai_Utils::FileMapping::open", "Failed to map file!");
+			}
+			data = (ubyte*)ptr;
+		}
+#endif
+		is_open = true;
+	}
+
+	void FileMapping::close() {
+#ifdef _WIN32
+		if (data) UnmapViewOfFile(data);
+		if (hMapping) CloseHandle((HANDLE)hMapping);
+		if (hFile) CloseHandle((HANDLE)hFile);
+		hMapping = NULL;
+		hFile = NULL;
+#else
+		if (data) munmap(data, size);
+		if (fd >= 0) ::close(fd);
+		fd = -1;
+#endif
+		data = NULL;
+		size = 0;
+		is_open = false;
+	}
+
+	/*----- MmapInputStreamer -----*/
+
+	void MmapInputStreamer::setWindow(const streampos startOffset, const streampos endOffset) {
+		const ubyte* base = mapping->getData();
+		start_boundary = startOffset;
+		end_boundary = endOffset;
+		window_start = base + static_cast<size_t>(startOffset);
+		window_end = base + static_cast<size_t>(endOffset);
+		current_pos = window_start;
+	}
+
+	const size_t MmapInputStreamer::fileSize() const {
+		if (is_open) return static_cast<size_t>(end_boundary - start_boundary);
+		if (mapping->isOpen()) return mapping->getSize();
+		try {
+			return static_cast<size_t>(std::filesystem::file_size(mapping->getPath()));
+		}
+		catch (filesystem_error& x) { return SIZE_UNKNOWN; }
+	}
+
+	const streampos MmapInputStreamer::setStartBoundary(const streampos position) {
+		if (position >= 0 && position < end_boundary) {
+			start_boundary = position;
+			if (is_open) {
+				window_start = mapping->getData() + static_cast<size_t>(position);
+				if (current_pos < window_start) current_pos = window_start;
+			}
+		}
+		return start_boundary;
+	}
+
+	const streampos MmapInputStreamer::setEndBoundary(const streampos position) {
+		size_t maxsz = is_open ? mapping->getSize() : SIZE_UNKNOWN;
+		if (position > start_boundary && (maxsz == SIZE_UNKNOWN || position <= static_cast<streampos>(maxsz))) {
+			end_boundary = position;
+			if (is_open) {
+				window_end = mapping->getData() + static_cast<size_t>(position);
+				if (current_pos > window_end) current_pos = window_end;
+			}
+		}
+		return end_boundary;
+	}
+
+	const streampos MmapInputStreamer::tell() {
+		if (!is_open) return SIZE_UNKNOWN;
+		return static_cast<streampos>(current_pos - window_start);
+	}
+
+	const streampos MmapInputStreamer::seek(const streampos pos) {
+		if (!is_open) return SIZE_UNKNOWN;
+		if (pos < 0 || pos > (end_boundary - start_boundary)) throw InputException("waffleoRai_Utils::MmapInputStreamer::seek", "Seek position is invalid!");
+		current_pos = window_start + static_cast<size_t>(pos);
+		return pos;
+	}
+
+	void MmapInputStreamer::open() {
+		if (is_open) return;
+		mapping->open();
+		read = 0;
+		setWindow(0, static_cast<streampos>(mapping->getSize()));
+		is_open = true;
+	}
+
+	void MmapInputStreamer::open(const streampos startOffset) {
+		if (is_open) return;
+		mapping->open();
+		const streampos maxsz = static_cast<streampos>(mapping->getSize());
+		if (startOffset < 0 || startOffset > maxsz) throw InputException("waffleoRai_Utils::MmapInputStreamer::open", "Open offset after end of file!");
+		read = 0;
+		setWindow(startOffset, maxsz);
+		is_open = true;
+	}
+
+	void MmapInputStreamer::open(const streampos startOffset, const size_t len) {
+		if (is_open) return;
+		mapping->open();
+		const streampos maxsz = static_cast<streampos>(mapping->getSize());
+		if (startOffset < 0 || startOffset > maxsz) throw InputException("waffleoRai_Utils::MmapInputStreamer::open", "Open offset after end of file!");
+		const streampos endOffset = startOffset + static_cast<streampos>(len);
+		if (endOffset > maxsz) throw InputException("waffleoRai_Utils::MmapInputStreamer::open", "End offset after end of file!");
+		read = 0;
+		setWindow(startOffset, endOffset);
+		is_open = true;
+	}
+
+	const size_t MmapInputStreamer::skip(const streampos skip_amt) {
+		if (!is_open) return SIZE_UNKNOWN;
+		const ubyte* startpos = current_pos;
+		size_t amt = static_cast<size_t>(skip_amt);
+		size_t rem = static_cast<size_t>(window_end - current_pos);
+		if (amt > rem) amt = rem;
+		current_pos += amt;
+		return static_cast<size_t>(current_pos - startpos);
+	}
+
+	void MmapInputStreamer::close() {
+		if (!is_open) return;
+		if (own_mapping) mapping->close();
+		current_pos = window_start = window_end = NULL;
+		is_open = false;
+	}
+
+	const size_t MmapInputStreamer::nextBytes(ubyte* dst, const size_t len) {
+		if (!is_open) throw InputException("waffleoRai_Utils::MmapInputStreamer::nextBytes", "Failed to retrieve data - stream is not open!");
+		size_t cpyamt = static_cast<size_t>(window_end - current_pos);
+		if (len < cpyamt) cpyamt = len;
+		if (cpyamt <= 0) return 0;
+		memcpy(dst, current_pos, cpyamt);
+		current_pos += cpyamt;
+		read += cpyamt;
+		return cpyamt;
+	}
+
+	const size_t MmapInputStreamer::peekSpan(const ubyte** span, const size_t len) {
+		*span = current_pos;
+		if (!is_open) return 0;
+		size_t avail = static_cast<size_t>(window_end - current_pos);
+		return len < avail ? len : avail;
+	}
+
+	const size_t MmapInputStreamer::consume(const size_t len) {
+		if (!is_open) return 0;
+		size_t avail = static_cast<size_t>(window_end - current_pos);
+		size_t amt = len < avail ? len : avail;
+		current_pos += amt;
+		read += amt;
+		return amt;
+	}
+
+	MmapInputStreamer::~MmapInputStreamer() {
+		close();
+		if (own_mapping) delete mapping;
+	}
+
 }
\ No newline at end of file
@@ -101,54 +101,47 @@ const size_t write_file_from_memory(const path& filepath, const void* src, const
 
 /*----- DataInputStreamer -----*/
 
-const uint16_t DataInputStreamer::nextUnsignedShort(){
-	const int bCount = 2;
-	uint16_t out = 0;
-	ubyte barr[bCount];
+const uint64_t DataInputStreamer::nextUnsignedValue(const int bCount){
+	uint64_t out = 0;
+	ubyte barr[8];
+
+	//Read straight out of the source's buffer if it will lend us the bytes
+	const ubyte* src = nullptr;
+	const bool borrowed = (iSource.peekSpan(&src, bCount) >= static_cast<size_t>(bCount));
+	if (!borrowed) {
+		for(int i = 0; i < bCount; i++) barr[i] = iSource.nextByte();
+		src = barr;
+	}
 
-	for(int i = 0; i < bCount; i++) barr[i] = iSource.nextByte();
 	if (eEndian == Endianness::big_endian){
 		//Start at beginning
 		for(int i = 0; i < bCount; i++){
 			out = out<<8;
-			out |= barr[i];
+			out |= src[i];
 		}
 	}
 	else if (eEndian == Endianness::little_endian){
 		//Start at end
 		for(int i = bCount-1; i >= 0; i--){
 			out = out<<8;
-			out |= barr[i];
+			out |= src[i];
 		}
 	}
+
+	if (borrowed) iSource.consume(bCount);
 	return out;
 }
 
+const uint16_t DataInputStreamer::nextUnsignedShort(){
+	return static_cast<uint16_t>(nextUnsignedValue(2));
+}
+
 const int16_t DataInputStreamer::nextShort(){
 	return (x16)nextUnsignedShort();
 }
 
 const uint32_t DataInputStreamer::nextUnsignedInt(){
-	const int bCount = 4;
-	uint32_t out = 0;
-	ubyte barr[bCount];
-
-	for(int i = 0; i < bCount; i++) barr[i] = iSource.nextByte();
-	if (eEndian == Endianness::big_endian){
-		//Start at beginning
-		for(int i = 0; i < bCount; i++){
-			out = out<<8;
-			out |= barr[i];
-		}
-	}
-	else if (eEndian == Endianness::little_endian){
-		//Start at end
-		for(int i = bCount-1; i >= 0; i--){
-			out = out<<8;
-			out |= barr[i];
-		}
-	}
-	return out;
+	return static_cast<uint32_t>(nextUnsignedValue(4));
 }
 
 const int32_t DataInputStreamer::nextInt(){
@@ -156,26 +149,7 @@ const int32_t DataInputStreamer::nextInt(){
 }
 
 const uint32_t DataInputStreamer::nextUnsigned24(){
-	const int bCount = 3;
-	uint32_t out = 0;
-	ubyte barr[bCount];
-
-	for(int i = 0; i < bCount; i++) barr[i] = iSource.nextByte();
-	if (eEndian == Endianness::big_endian){
-		//Start at beginning
-		for(int i = 0; i < bCount; i++){
-			out = out<<8;
-			out |= barr[i];
-		}
-	}
-	else if (eEndian == Endianness::little_endian){
-		//Start at end
-		for(int i = bCount-1; i >= 0; i--){
-			out = out<<8;
-			out |= barr[i];
-		}
-	}
-	return out;
+	return static_cast<uint32_t>(nextUnsignedValue(3));
 }
 
 const int32_t DataInputStreamer::next24(){
@@ -185,30 +159,60 @@ const int32_t DataInputStreamer::next24(){
 }
 
 const uint64_t DataInputStreamer::nextUnsignedLong(){
-	const int bCount = 8;
-	uint64_t out = 0;
-	ubyte barr[bCount];
+	return nextUnsignedValue(8);
+}
+
+const int64_t DataInputStreamer::nextLong(){
+	return (x64)nextUnsignedLong();
+}
+
+//Cap a bulk read at the number of whole values left, so a trailing partial value stays in the source.
+static const size_t wholeValuesLeft(const DataStreamerSource& src, const size_t n, const size_t width){
+	if (!src.remainingToEndKnown()) return n;
+	size_t left = src.remaining() / width;
+	return left < n ? left : n;
+}
+
+const size_t DataInputStreamer::nextUnsignedShorts(uint16_t* dst, const size_t n){
+	if (!dst || n <= 0) return 0;
+	size_t got = iSource.nextBytes(reinterpret_cast<ubyte*>(dst), wholeValuesLeft(iSource, n, 2) << 1) >> 1;
+	if (!sys_endian_matches(eEndian)) wrcu_reverseBytes16Array(dst, got);
+	return got;
+}
 
-	for(int i = 0; i < bCount; i++) barr[i] = iSource.nextByte();
+const size_t DataInputStreamer::nextUnsigned24s(uint32_t* dst, const size_t n){
+	if (!dst || n <= 0) return 0;
+	//Pull the packed triplets into the front of dst, then spread them out back to front
+	ubyte* raw = reinterpret_cast<ubyte*>(dst);
+	size_t got = iSource.nextBytes(raw, wholeValuesLeft(iSource, n, 3) * 3) / 3;
+	size_t i = got;
 	if (eEndian == Endianness::big_endian){
-		//Start at beginning
-		for(int i = 0; i < bCount; i++){
-			out = out<<8;
-			out |= barr[i];
+		while (i-- > 0) {
+			const ubyte* b = raw + (i * 3);
+			dst[i] = (static_cast<uint32_t>(b[0]) << 16) | (static_cast<uint32_t>(b[1]) << 8) | b[2];
 		}
 	}
-	else if (eEndian == Endianness::little_endian){
-		//Start at end
-		for(int i = bCount-1; i >= 0; i--){
-			out = out<<8;
-			out |= barr[i];
+	else {
+		while (i-- > 0) {
+			const ubyte* b = raw + (i * 3);
+			dst[i] = (static_cast<uint32_t>(b[2]) << 16) | (static_cast<uint32_t>(b[1]) << 8) | b[0];
 		}
 	}
-	return out;
+	return got;
 }
 
-const int64_t DataInputStreamer::nextLong(){
-	return (x64)nextUnsignedLong();
+const size_t DataInputStreamer::nextUnsignedInts(uint32_t* dst, const size_t n){
+	if (!dst || n <= 0) return 0;
+	size_t got = iSource.nextBytes(reinterpret_cast<ubyte*>(dst), wholeValuesLeft(iSource, n, 4) << 2) >> 2;
+	if (!sys_endian_matches(eEndian)) wrcu_reverseBytes32Array(dst, got);
+	return got;
+}
+
+const size_t DataInputStreamer::nextUnsignedLongs(uint64_t* dst, const size_t n){
+	if (!dst || n <= 0) return 0;
+	size_t got = iSource.nextBytes(reinterpret_cast<ubyte*>(dst), wholeValuesLeft(iSource, n, 8) << 3) >> 3;
+	if (!sys_endian_matches(eEndian)) wrcu_reverseBytes64Array(dst, got);
+	return got;
 }
 
 const size_t DataInputStreamer::skip(streampos amt){
@@ -361,8 +365,15 @@ void DataInputStreamer::initconv_utf32_sysordered() {
 }
 
 const size_t DataInputStreamer::readASCIIString(string& dst, const size_t sz_bytes) {
-	size_t i;
-	for (i = 0; i < sz_bytes; i++) {
+	size_t i = 0;
+	const ubyte* span = nullptr;
+	size_t avail = 0;
+	while (i < sz_bytes && (avail = iSource.peekSpan(&span, sz_bytes - i)) > 0) {
+		dst.append(reinterpret_cast<const char*>(span), avail);
+		iSource.consume(avail);
+		i += avail;
+	}
+	for (; i < sz_bytes; i++) {
 		if (streamEnd()) return i;
 		dst.push_back(static_cast<char>(nextByte()));
 	}
@@ -374,9 +385,17 @@ const size_t DataInputStreamer::readASCIIString(UnicodeString& dst, const size_t
 }
 
 const size_t DataInputStreamer::readASCIIString(char16_t* dst, const size_t sz_bytes) {
-	size_t i;
+	size_t i = 0;
 	char16_t* pos = dst;
-	for (i = 0; i < sz_bytes; i++) {
+	const ubyte* span = nullptr;
+	size_t avail = 0;
+	while (i < sz_bytes && (avail = iSource.peekSpan(&span, sz_bytes - i)) > 0) {
+		const ubyte* span_end = span + avail;
+		while (span < span_end) *(pos++) = static_cast<char16_t>(*span++);
+		iSource.consume(avail);
+		i += avail;
+	}
+	for (; i < sz_bytes; i++) {
 		if (streamEnd()) return i;
 		*(pos++) = static_cast<char16_t>(nextByte());
 	}
@@ -384,9 +403,17 @@ const size_t DataInputStreamer::readASCIIString(char16_t* dst, const size_t sz_b
 }
 
 const size_t DataInputStreamer::readASCIIString(char32_t* dst, const size_t sz_bytes) {
-	size_t i;
+	size_t i = 0;
 	char32_t* pos = dst;
-	for (i = 0; i < sz_bytes; i++) {
+	const ubyte* span = nullptr;
+	size_t avail = 0;
+	while (i < sz_bytes && (avail = iSource.peekSpan(&span, sz_bytes - i)) > 0) {
+		const ubyte* span_end = span + avail;
+		while (span < span_end) *(pos++) = static_cast<char32_t>(*span++);
+		iSource.consume(avail);
+		i += avail;
+	}
+	for (; i < sz_bytes; i++) {
 		if (streamEnd()) return i;
 		*(pos++) = static_cast<char32_t>(nextByte());
 	}
@@ -1,65 +1,200 @@
 
 #include "lz77.h"
 
+#include <algorithm>
+
 namespace waffleoRai_Utils{
 
 /*--- LZ77 Decompressor ---*/
 
+static inline void lzBackCopy(ubyte* dst, const size_t dist, const size_t n){
+    const ubyte* from = dst - dist;
+    if(dist >= n) memcpy(dst, from, n);
+    else if(dist == 1) memset(dst, *from, n);
+    else{
+        //Overlapping: lay down one period, then keep doubling what's been written
+        memcpy(dst, from, dist);
+        size_t done = dist;
+        while(done < n){
+            const size_t amt = done < (n - done) ? done : (n - done);
+            memcpy(dst + done, dst, amt);
+            done += amt;
+        }
+    }
+}
+
+const bool LZ77Decompressor::reserveHistory(size_t amt){
+    if(hist_p1 + amt <= history + hist_sz) return true;
+    if(hist_external) return false; //Caller's buffer is full; can't slide or grow it
+
+    //Slide everything still needed (the back window and anything unread) down to the start
+    size_t back = (size_t)(hist_p1 - history);
+    if(back > back_win_size) back = back_win_size;
+    ubyte* keep = hist_p1 - back;
+    if(hist_p0 < keep) keep = hist_p0;
+    const size_t kept = (size_t)(hist_p1 - keep);
+    if(keep > history) memmove(history, keep, kept);
+    hist_p0 = history + (hist_p0 - keep);
+    hist_p1 = history + kept;
+    if(hist_p1 + amt <= history + hist_sz) return true;
+
+    //Command puts out more than the front window. Shouldn't happen, but grow rather than lose bytes.
+    const size_t p0off = (size_t)(hist_p0 - history);
+    ubyte* nbuff = (ubyte*)realloc(history, kept + amt + back_win_size);
+    if(!nbuff) return false;
+    history = nbuff;
+    hist_sz = kept + amt + back_win_size;
+    hist_p0 = history + p0off;
+    hist_p1 = history + kept;
+    return true;
+}
+
 const uint LZ77Decompressor::bufferBlock(){
     if(streamEnd()) return false;
 
     //Determine what to do next.
     if(!processNextCommand()) return false;
+    if(!reserveHistory((size_t)read_plain + backread_count)) return false;
 
     //Copy plaintext...
-    uint count = 0;
-    for(uint i = 0; i < read_plain; i++){
-        ubyte b = src.nextByte();
-        if(rwin.put(b)) count++;
-        else return count;
-
-        if(bwin.isFull()) bwin.pop();
-        bwin.put(b);
-    }
+    uint count = (uint)src.nextBytes(hist_p1, read_plain);
+    hist_p1 += count;
+    if(count < read_plain) return count;
 
     //Backcopy...
     if(backread_count > 0){
-        if (!bwin.setRandomAccessPositionBack(backread_off)) {
-            printf("DEBUG -- Uh oh, we have a back window problem... Read count: 0x%llx\n", read_count);
-            return count;
-        } 
-        for(uint i = 0; i < backread_count; i++){
-            ubyte b = bwin.getNextRAByte();
-
-            if(rwin.put(b)) count++;
-            else {
-                printf("DEBUG -- Uh oh, we have a read window problem... Read count: 0x%llx\n", read_count);
-                return count;
-            }
+        const size_t dist = backread_off;
+        if (dist == 0 || dist > (size_t)(hist_p1 - history)) return count;
 
-            if(bwin.isFull()) bwin.pop();
-            bwin.put(b);
-        }
+        lzBackCopy(hist_p1, dist, backread_count);
+        hist_p1 += backread_count;
+        count += backread_count;
     }
 
     return count;
 }
 
 const int LZ77Decompressor::get() {
-    if (rwin.isEmpty() && !bufferBlock()) return EOF;
+    if (hist_p0 >= hist_p1 && !bufferBlock()) return EOF;
     return static_cast<int>(nextByte()) & 0xff;
 }
 
 const ubyte LZ77Decompressor::nextByte(){
-    //Check if there are bytes left
-    //if(streamEnd()) return 0xFF;
-
     //Check read buffer for bytes
     //If read buffer is empty, do next block
-    if(rwin.isEmpty() && !bufferBlock()) return 0xFF;
+    if(hist_p0 >= hist_p1 && !bufferBlock()) return 0xFF;
 
     read_count++;
-    return rwin.pop();
+    return *(hist_p0++);
+}
+
+const size_t LZ77Decompressor::peekSpan(const ubyte** span, const size_t len){
+    if(hist_p0 >= hist_p1 && !bufferBlock()){
+        *span = nullptr;
+        return 0;
+    }
+    *span = hist_p0;
+    size_t avail = (size_t)(hist_p1 - hist_p0);
+    if(avail > decomp_size - read_count) avail = decomp_size - read_count;
+    return len < avail ? len : avail;
+}
+
+const size_t LZ77Decompressor::consume(const size_t len){
+    size_t ct = 0;
+    const ubyte* span = nullptr;
+    while(ct < len){
+        const size_t amt = peekSpan(&span, len - ct);
+        if(amt == 0) break;
+        hist_p0 += amt;
+        read_count += amt;
+        ct += amt;
+    }
+    return ct;
+}
+
+const size_t LZ77Decompressor::nextBytes(ubyte* dst, const size_t len){
+    size_t ct = 0;
+    const ubyte* span = nullptr;
+    while(ct < len){
+        const size_t amt = peekSpan(&span, len - ct);
+        if(amt == 0) break;
+        memcpy(dst + ct, span, amt);
+        hist_p0 += amt;
+        read_count += amt;
+        ct += amt;
+    }
+    return ct;
+}
+
+const size_t LZ77Decompressor::decodeInto(ubyte* dst, const size_t len){
+    //Back references only reach into dst, so this only works from the start of the stream
+    if(read_count > 0 || hist_p1 > history) return nextBytes(dst, len);
+
+    //The caller's buffer stands in as the history, so output never has to be copied
+    ubyte* own = history;
+    const size_t own_sz = hist_sz;
+    history = hist_p0 = hist_p1 = dst;
+    hist_sz = len;
+    hist_external = true;
+    while((size_t)((dst + len) - hist_p1) >= front_win_size){
+        if(!bufferBlock()) break;
+        hist_p0 = hist_p1;
+        read_count = (size_t)(hist_p1 - dst);
+    }
+    const size_t ct = (size_t)(hist_p1 - dst);
+
+    //Carry the back window over so streaming can pick up where this left off
+    history = own;
+    hist_sz = own_sz;
+    hist_external = false;
+    const size_t keep = ct < back_win_size ? ct : back_win_size;
+    memcpy(history, dst + (ct - keep), keep);
+    hist_p0 = hist_p1 = history + keep;
+    read_count = ct;
+
+    //The last few commands might not fit whole, so they go through the normal buffer
+    if(ct < len) return ct + nextBytes(dst + ct, len - ct);
+    return ct;
+}
+
+const size_t LZ77Decompressor::decodeFlat(const ubyte* src, const size_t srclen, ubyte* dst, const size_t dstlen, bool* supported){
+    //Commands are parsed straight out of src and everything lands in dst, which is the whole history
+    *supported = true;
+    if(read_count > 0 || hist_p1 > history){
+        *supported = false;
+        return 0;
+    }
+    const size_t limit = (decomp_size > 0 && decomp_size < dstlen) ? decomp_size : dstlen;
+    size_t ip = 0;
+    size_t op = 0;
+    while(op < limit){
+        const int used = decodeCommand(src + ip, srclen - ip);
+        if(used < 0){
+            *supported = false;
+            return 0;
+        }
+        if(used == 0) break;
+        ip += (size_t)used;
+
+        size_t n = read_plain;
+        if(n > srclen - ip) n = srclen - ip;
+        if(n > limit - op) n = limit - op;
+        memcpy(dst + op, src + ip, n);
+        ip += n;
+        op += n;
+        if(n < read_plain) break;
+
+        if(backread_count > 0){
+            const size_t dist = backread_off;
+            if(dist == 0 || dist > op) break;
+            n = backread_count;
+            if(n > limit - op) n = limit - op;
+            lzBackCopy(dst + op, dist, n);
+            op += n;
+        }
+    }
+    read_count = op;
+    return op;
 }
 
 const bool LZ77Decompressor::remainingToEndKnown() const {
@@ -72,7 +207,7 @@ const size_t LZ77Decompressor::remaining() const{
 }
 
 const bool LZ77Decompressor::streamEnd() const{
-    return ((src.streamEnd() && rwin.isEmpty()) || (decomp_size > 0 && read_count >= decomp_size));
+    return ((src.streamEnd() && hist_p0 >= hist_p1) || (decomp_size > 0 && read_count >= decomp_size));
 }
 
 void LZ77Decompressor::close(){
@@ -82,106 +217,349 @@ void LZ77Decompressor::close(){
     closed = true;
 }
 
-/*--- LZ77 Compressor ---*/
+/*--- LZ Match Finder ---*/
 
-void LZ77Compressor::processNextByte() {
-    u32 fpos = 0;
-    u32 bpos = 0;
-    u32 bsize, fsize;
-    int spos = 0;
-    int i = 0;
-    bool usef = false;
-    ubyte bytef = 0, byter = 0;
-    ubyte first_byte = 0;
-    uint32_t minrun = global_streak_min;
-    vector<LZCompRule>::const_iterator vitr = streak_mins.cbegin();
-    vector<LZCompRule>::const_iterator vend = streak_mins.cend();
-
-    streak_count = 0;
-    streak_off = 0;
-    bsize = bwin.getCurrentSize();
-    fsize = fwin.getCurrentSize();
-
- /*   printf("fwin peek: ");
-    for (int i = 0; i < 16; i++) printf("%02x ", fwin.getByteAt(i));
-    printf("\nbwin back: ");
-    int readback = bsize < 16 ? bsize : 16;
-    bwin.setRandomAccessPositionBack(readback);
-    for (int i = 0; i < readback; i++) printf("%02x ", bwin.getNextRAByte());
-    printf("\n");
-    */
-
-    first_byte = fwin.getByteAt(0);
-    for (bpos = 0; bpos < bsize; bpos++) {
-
-        if (bwin.getByteFromBack(bpos+1) != first_byte) continue;
-
-        spos = bpos - 1; usef = false; fpos = 1;
-        fwin.setRandomAccessPosition(1);
-        if (spos < 0) {
-            usef = true;
-            spos = 0;
-        }
-        else bwin.setRandomAccessPositionBack(bpos);
-        do {
-            if (fpos >= fsize) break;
-            if (usef && (spos >= fsize)) break;
-
-            bytef = fwin.getNextRAByte(); fpos++;
-            if (usef) {
-                byter = fwin.getByteAt(spos++);
+static inline u32 lzHash3(const ubyte* p) {
+    const u32 v = ((u32)p[0] << 16) | ((u32)p[1] << 8) | (u32)p[2];
+    return (v * 2654435761U) >> (32 - LZ77_HASH_BITS);
+}
+
+static inline const u32 lzMinRun(const u32 global_min, const vector<LZCompRule>& rules, const size_t bpos) {
+    u32 minrun = global_min;
+    for (const LZCompRule& r : rules) {
+        if (bpos < r.max_offset) break;
+        minrun = r.max_run;
+    }
+    return minrun;
+}
+
+LZMatchFinder::LZMatchFinder(size_t back_window_size, size_t front_window_size) {
+    max_dist = back_window_size;
+    max_run = front_window_size;
+
+    //Room for the window, the optimal parser's lookahead, and some slack so sliding doesn't happen every byte
+    buffer_sz = (back_window_size << 1) + (front_window_size * LZ77_OPT_LOOKAHEAD) + 1;
+    buffer = (ubyte*)malloc(buffer_sz);
+    view = buffer;
+
+    size_t csize = 1;
+    while (csize < back_window_size) csize <<= 1;
+    chain_mask = csize - 1;
+    chain = (size_t*)calloc(csize, sizeof(size_t));
+    head = (size_t*)calloc((size_t)1 << LZ77_HASH_BITS, sizeof(size_t));
+}
+
+void LZMatchFinder::slide() {
+    //Only the back window in front of cur has to stay
+    size_t keep = cur > max_dist ? cur - max_dist : 0;
+    if (keep <= base) return;
+    memmove(buffer, buffer + (keep - base), end - keep);
+    base = keep;
+    if (ins < keep) ins = keep;
+}
+
+void LZMatchFinder::putByte(ubyte b) {
+    if (end - base >= buffer_sz) slide();
+    buffer[(end++) - base] = b;
+}
+
+void LZMatchFinder::putBytes(const ubyte* data, size_t len) {
+    while (len > 0) {
+        if (end - base >= buffer_sz) slide();
+        size_t amt = buffer_sz - (end - base);
+        if (amt > len) amt = len;
+        memcpy(buffer + (end - base), data, amt);
+        end += amt;
+        data += amt;
+        len -= amt;
+    }
+}
+
+void LZMatchFinder::attach(const ubyte* data, size_t len, size_t pos) {
+    reset();
+    view = data;
+    attached_len = len;
+    cur = end = pos;
+    ins = pos > max_dist ? pos - max_dist : 0;
+}
+
+void LZMatchFinder::reset() {
+    base = cur = end = ins = 0;
+    view = buffer;
+    attached_len = 0;
+    memset(chain, 0, (chain_mask + 1) * sizeof(size_t));
+    memset(head, 0, ((size_t)1 << LZ77_HASH_BITS) * sizeof(size_t));
+    if (last1) memset(last1, 0, 0x100 * sizeof(size_t));
+    if (last2) memset(last2, 0, 0x10000 * sizeof(size_t));
+}
+
+void LZMatchFinder::insertPending(const size_t pos) {
+    //Everything behind pos goes into the chains. A position needs 3 bytes loaded to be hashed, which only fails at the very end of input.
+    for (; ins < pos; ins++) {
+        const ubyte* p = view + (ins - base);
+        if (ins + 3 <= end) {
+            const u32 h = lzHash3(p);
+            chain[ins & chain_mask] = head[h];
+            head[h] = ins + 1;
+        }
+        if (last1) {
+            last1[p[0]] = ins + 1;
+            if (ins + 2 <= end) last2[((u32)p[0] << 8) | p[1]] = ins + 1;
+        }
+    }
+}
+
+const u32 LZMatchFinder::search(const size_t pos, const u32 global_min, const vector<LZCompRule>& rules, size_t* best_dist, vector<LZMatch>* found) {
+    if (!rules_checked) {
+        //Runs shorter than the hash prefix need their own lookup. Rules are set up before the first byte is encoded.
+        u32 shortest = global_min;
+        for (const LZCompRule& r : rules) {
+            if (r.max_run < shortest) shortest = r.max_run;
+        }
+        if (shortest < 3) {
+            last1 = (size_t*)calloc(0x100, sizeof(size_t));
+            last2 = (size_t*)calloc(0x10000, sizeof(size_t));
+        }
+        rules_checked = true;
+    }
+    insertPending(pos);
+
+    *best_dist = 0;
+    if (pos >= end) return 0;
+    const size_t lookahead = end - pos < max_run ? end - pos : max_run;
+    const size_t dmax = pos < max_dist ? pos : max_dist;
+    const ubyte* fpos = view + (pos - base);
+
+    //Chains may already hold positions past pos if an earlier search looked further ahead. Those are skipped.
+    u32 best = 0;
+    if (last1) {
+        //Closest 1 then 2 byte prefix
+        size_t cand = last1[fpos[0]];
+        if (cand > 0 && cand <= pos && pos - (cand - 1) <= dmax && 1 >= global_min && 1 >= lzMinRun(global_min, rules, pos - cand)) {
+            best = 1;
+            *best_dist = pos - (cand - 1);
+            if (found) found->push_back(LZMatch(1, (u32)(*best_dist - 1)));
+        }
+        if (lookahead >= 2) {
+            cand = last2[((u32)fpos[0] << 8) | fpos[1]];
+            if (cand > 0 && cand <= pos && pos - (cand - 1) <= dmax && 2 >= global_min && 2 >= lzMinRun(global_min, rules, pos - cand)) {
+                best = 2;
+                *best_dist = pos - (cand - 1);
+                if (found) found->push_back(LZMatch(2, (u32)(*best_dist - 1)));
+            }
+        }
+    }
+
+    if (lookahead >= 3) {
+        //Nearest candidates come first, so ties keep the smallest offset
+        size_t cand = head[lzHash3(fpos)];
+        u32 depth = max_chain;
+        while (cand > 0) {
+            const size_t cpos = cand - 1;
+            const size_t next = chain[cpos & chain_mask];
+            if (next >= cand) break;
+            if (cpos >= pos) {
+                cand = next;
+                continue;
             }
-            else {
-                byter = bwin.getNextRAByte(); spos--;
-                if (spos < 0) {
-                    usef = true;
-                    spos = 0;
+            const size_t dist = pos - cpos;
+            if (dist > dmax) break;
+
+            const ubyte* bpos = view + (cpos - base);
+            if (bpos[best] == fpos[best] && bpos[0] == fpos[0] && bpos[1] == fpos[1] && bpos[2] == fpos[2]) {
+                //Match may run on into the lookahead (overlapping copy)
+                size_t len = 3;
+                while (len < lookahead && bpos[len] == fpos[len]) len++;
+                if (len > best && len >= global_min && len >= lzMinRun(global_min, rules, dist - 1)) {
+                    best = (u32)len;
+                    *best_dist = dist;
+                    if (found) found->push_back(LZMatch(best, (u32)(dist - 1)));
+                    if (len >= lookahead) break; //Can't do better
                 }
             }
-        } while (bytef == byter);
 
-        //fpos represents how many were read, which may be one more than were matched.
-        if (bytef != byter) fpos--; //If it broke from mismatch, not because end was reached.
-        if (fpos < minrun) continue;
+            if (max_chain && --depth == 0) break;
+            cand = next;
+        }
+    }
+
+    return best;
+}
+
+const u32 LZMatchFinder::findMatch(const u32 global_min, const vector<LZCompRule>& rules, u32* offset, const size_t ahead) {
+    size_t dist = 0;
+    const u32 run = search(cur + ahead, global_min, rules, &dist, nullptr);
+    *offset = run > 0 ? (u32)(dist - 1) : 0;
+    return run;
+}
+
+const size_t LZMatchFinder::findMatches(const u32 global_min, const vector<LZCompRule>& rules, vector<LZMatch>& out, const size_t ahead) {
+    size_t dist = 0;
+    out.clear();
+    search(cur + ahead, global_min, rules, &dist, &out);
+    return out.size();
+}
+
+LZMatchFinder::~LZMatchFinder() {
+    free(buffer);
+    free(chain);
+    free(head);
+    free(last1);
+    free(last2);
+}
+
+/*--- LZ77 Compressor ---*/
+
+void LZ77Compressor::parseLazy() {
+    LZMatch here;
+    if (lazy_valid && lazy_pos == finder.getPosition()) here = lazy_match;
+    else here.run = finder.findMatch(global_streak_min, streak_mins, &here.offset);
+    lazy_valid = false;
+
+    streak_count = here.run;
+    streak_off = here.offset;
+    if (here.run == 0 || here.run >= finder.getLookaheadSize()) return;
+    if (global_streak_max && here.run >= global_streak_max) return;
+
+    //If the next byte starts a longer run, this one becomes a literal
+    LZMatch next;
+    next.run = finder.findMatch(global_streak_min, streak_mins, &next.offset, 1);
+    if (global_streak_max && next.run > global_streak_max) next.run = global_streak_max;
+    if (next.run > here.run) {
+        streak_count = 0;
+        streak_off = 0;
+        lazy_match = next;
+        lazy_pos = finder.getPosition() + 1;
+        lazy_valid = true;
+    }
+}
 
-        //Update minimum run size...
-        while (vitr != vend && bpos >= vitr->max_offset) {
-            minrun = vitr->max_run;
-            vitr++;
+void LZ77Compressor::buildPlan() {
+    //Shortest path over the whole lookahead, one node per byte. Edges are a literal, or any run length reachable at each offset found.
+    const size_t horizon = finder.getLookaheadSize();
+    plan_cost.assign(horizon + 1, ~0ULL);
+    plan_edge.resize(horizon + 1);
+    plan_cost[0] = 0;
+
+    const u32 litcost = encodeCost(0, 0);
+    const u32 maxrun = global_streak_max ? global_streak_max : ~0U;
+    for (size_t i = 0; i < horizon; i++) {
+        const u64 here = plan_cost[i];
+        if (here + litcost < plan_cost[i + 1]) {
+            plan_cost[i + 1] = here + litcost;
+            plan_edge[i + 1] = LZMatch(0, 0);
         }
-        if (fpos < minrun) continue;
-        if ((fpos > streak_count)) {
-            streak_count = fpos;
-            streak_off = bpos;
+
+        finder.findMatches(global_streak_min, streak_mins, plan_found, i);
+        u32 run = 1;
+        for (const LZMatch& m : plan_found) {
+            const u32 minrun = lzMinRun(global_streak_min, streak_mins, m.offset);
+            if (run < minrun) run = minrun;
+            if (run < global_streak_min) run = global_streak_min;
+            for (; run <= m.run && run <= maxrun; run++) {
+                //Ties go to the later start, which keeps earlier runs long like greedy does
+                const u64 cost = here + encodeCost(run, m.offset);
+                if (cost <= plan_cost[i + run]) {
+                    plan_cost[i + run] = cost;
+                    plan_edge[i + run] = LZMatch(run, m.offset);
+                }
+            }
         }
     }
-    //printf("\n");
+
+    //Walk back from the end of the window, then flip into encode order
+    plan.clear();
+    size_t i = horizon;
+    while (i > 0) {
+        const LZMatch& step = plan_edge[i];
+        plan.push_back(step);
+        i -= step.run > 0 ? step.run : 1;
+    }
+    std::reverse(plan.begin(), plan.end());
+
+    //Runs in the last front window were cut short by the end of the lookahead, so stop before it and replan from there
+    if (horizon >= front_win_size * LZ77_OPT_LOOKAHEAD) {
+        size_t covered = 0;
+        size_t keep = 0;
+        while (keep < plan.size() && covered < horizon - front_win_size) {
+            covered += plan[keep].run > 0 ? plan[keep].run : 1;
+            keep++;
+        }
+        plan.resize(keep);
+    }
+    plan_idx = 0;
+    plan_pos = finder.getPosition();
+}
+
+void LZ77Compressor::parseOptimal() {
+    //Replan if the encoder didn't take the block it was given (eg. clamped a run)
+    if (plan_idx >= plan.size() || plan_pos != finder.getPosition()) buildPlan();
+
+    const LZMatch& step = plan[plan_idx++];
+    streak_count = step.run;
+    streak_off = step.offset;
+    plan_pos += step.run > 0 ? step.run : 1;
+}
+
+void LZ77Compressor::processNextByte() {
+    switch (parse_mode) {
+    case LZ_PARSE_LAZY:
+        parseLazy();
+        break;
+    case LZ_PARSE_OPTIMAL:
+        parseOptimal();
+        break;
+    default:
+        streak_count = finder.findMatch(global_streak_min, streak_mins, &streak_off);
+        break;
+    }
 }
 
 const int LZ77Compressor::get() {
-    if (write_buffer.isEmpty() && fwin.isEmpty() && src.streamEnd()) return EOF;
+    if (write_buffer.isEmpty() && finder.getLookaheadSize() == 0 && src.streamEnd()) return EOF;
     return static_cast<int>(nextByte()) & 0xff;
 }
 
-const ubyte LZ77Compressor::nextByte() {
-    int read = 0;
-    int i = 0;
+void LZ77Compressor::primeDictionary(const ubyte* data, size_t len) {
+    if (input_bytes > 0 || finder.getPosition() > 0) return;
 
-    if (!write_buffer.isEmpty()) {
-        output_bytes++;
-        return write_buffer.pop();
+    //Only the back window's worth can ever be referenced
+    if (len > back_win_size) {
+        data += len - back_win_size;
+        len = back_win_size;
+    }
+    finder.putBytes(data, len);
+    finder.advance(len);
+    for (size_t i = 0; i < len; i++) {
+        if (bwin.isFull()) bwin.pop();
+        bwin.put(data[i]);
     }
+}
 
-    while (!fwin.isFull() && !src.streamEnd()) {
-        /*ubyte b = src.nextByte();
-        printf("Read byte into forward window: %02x | Position = %llx\n", b, input_bytes);
-        fwin.put(b);*/
+const bool LZ77Compressor::encodeNextBlock() {
+    int read = 0;
+    int i = 0;
 
-        fwin.put(src.nextByte());
-        input_bytes++;
+    //Input goes to the match finder first, which can look further ahead than fwin when parsing optimally
+    const size_t ahead = parse_mode == LZ_PARSE_OPTIMAL ? (front_win_size * LZ77_OPT_LOOKAHEAD) : front_win_size;
+    while (finder.getLookaheadSize() < ahead && !src.streamEnd()) {
+        const ubyte* span = nullptr;
+        size_t amt = src.peekSpan(&span, ahead - finder.getLookaheadSize());
+        if (amt > 0) {
+            finder.putBytes(span, amt);
+            src.consume(amt);
+        }
+        else {
+            finder.putByte(src.nextByte());
+            amt = 1;
+        }
+        input_bytes += amt;
+    }
+    while (!fwin.isFull() && fwin.getCurrentSize() < finder.getLookaheadSize()) {
+        fwin.put(finder.getByteAhead(fwin.getCurrentSize()));
     }
 
-    if (fwin.isEmpty()) return 0;
+    if (fwin.isEmpty()) return false;
     processNextByte();
     read = encodeToWriteBuffer();
 
@@ -189,11 +567,58 @@ const ubyte LZ77Compressor::nextByte() {
         if (bwin.isFull()) bwin.pop();
         bwin.put(fwin.pop());
     }
+    finder.advance(read);
+    return true;
+}
+
+const size_t LZ77Compressor::encodeFlat(const ubyte* data, const size_t start, const size_t len, ubyte* dst, const size_t dstcap, bool* supported) {
+    //Same parse as encodeNextBlock, but the finder reads data in place and blocks go straight to dst
+    *supported = true;
+    if (input_bytes > 0 || finder.getPosition() > 0) {
+        *supported = false;
+        return 0;
+    }
+    finder.attach(data, len, start);
+    const size_t ahead = parse_mode == LZ_PARSE_OPTIMAL ? (front_win_size * LZ77_OPT_LOOKAHEAD) : front_win_size;
+    size_t ct = 0;
+    while (finder.getPosition() < len) {
+        finder.loadAhead(ahead);
+        processNextByte();
+        size_t written = 0;
+        const int read = encodeToBuffer(data + finder.getPosition(), dst + ct, dstcap - ct, &written);
+        if (read < 0) {
+            *supported = false;
+            return 0;
+        }
+        if (read == 0) return 0;
+        ct += written;
+        finder.advance((size_t)read);
+    }
+    input_bytes = len - start;
+    output_bytes = ct;
+    return ct;
+}
+
+const ubyte LZ77Compressor::nextByte() {
+    if (write_buffer.isEmpty() && !encodeNextBlock()) return 0;
 
     output_bytes++;
     return write_buffer.pop();
 }
 
+const size_t LZ77Compressor::nextBytes(ubyte* dst, const size_t len) {
+    size_t ct = 0;
+    while (ct < len) {
+        if (write_buffer.isEmpty()) {
+            if (!encodeNextBlock()) break;
+            if (write_buffer.isEmpty()) continue;
+        }
+        while (ct < len && !write_buffer.isEmpty()) dst[ct++] = write_buffer.pop();
+    }
+    output_bytes += ct;
+    return ct;
+}
+
 const size_t LZ77Compressor::remaining() const {
     //HMMMMM that's a problem. Might just have to return what's in the write buffer.
     return write_buffer.getCurrentSize();
@@ -201,7 +626,7 @@ const size_t LZ77Compressor::remaining() const {
 
 const bool LZ77Compressor::streamEnd() const {
     //printf("%d %d %d\n", write_buffer.getCurrentSize(), fwin.getCurrentSize(), src.streamEnd());
-    return write_buffer.isEmpty() && fwin.isEmpty() && src.streamEnd();
+    return write_buffer.isEmpty() && finder.getLookaheadSize() == 0 && src.streamEnd();
 }
 
 void LZ77Compressor::close() {
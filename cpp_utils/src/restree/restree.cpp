@@ -93,7 +93,9 @@ ResourceCard& ResourceCard::operator=(const ResourceCard& other){
         offset = other.offset;
         rawSize = other.rawSize;
         decompSize = other.decompSize;
+        misc_flags = other.misc_flags;
         compressed = other.compressed;
+        isValid = other.isValid;
         name = other.name;
     }
     return *this;
@@ -134,11 +136,27 @@ const path& PathTable::getPathAtIndex(const int idx) {
 	return str_vec[idx];
 }
 
+const path PathTable::resolve(const path& p) const {
+	if (base_path.empty() || p.is_absolute()) return p;
+	return base_path / p;
+}
+
+void PathTable::setBasePath(const path& base) {
+	//Only paths that are still relative are affected - this does not re-root paths resolved against an earlier base
+	if (!base.empty()) {
+		for (path& p : str_vec) {
+			if (p.is_relative()) p = base / p;
+		}
+	}
+	base_path = base;
+}
+
 const int PathTable::findPath(const path& p) {
+	const path rp = resolve(p);
 	vector<path>::const_iterator itr;
 	int i = 0;
 	for (itr = str_vec.begin(); itr < str_vec.end(); itr++) {
-		if (*(itr) == p) return i;
+		if (*(itr) == rp) return i;
 		i++;
 	}
 	return -1;
@@ -147,127 +165,430 @@ const int PathTable::findPath(const path& p) {
 const int PathTable::addPath(const path& p) {
 	int idx = findPath(p);
 	if (idx >= 0) return idx;
-	str_vec.push_back(p);
+	str_vec.push_back(resolve(p));
 	return str_vec.size()-1;
 }
 
+/*--- Resource Key Index ---*/
+
+const size_t ResourceKeyIndex::findSlot(const ResourceKey& key, const vector<ResourceKey>& keys) const{
+	if(count == 0) return SIZE_UNKNOWN;
+	u32 hash = hashKey(key);
+	size_t pos = hash & mask;
+	size_t dist = 0;
+	while(true){
+		const Slot& slot = slots[pos];
+		if(slot.idx == EMPTY_SLOT) return SIZE_UNKNOWN;
+		//Robin Hood invariant: if this resident is closer to home than we are, the key isn't here
+		if(probeDistance(pos, slot.hash) < dist) return SIZE_UNKNOWN;
+		if(slot.hash == hash && keys[slot.idx] == key) return pos;
+		pos = (pos + 1) & mask;
+		dist++;
+	}
+}
+
+void ResourceKeyIndex::place(Slot slot){
+	size_t pos = slot.hash & mask;
+	size_t dist = 0;
+	while(true){
+		Slot& here = slots[pos];
+		if(here.idx == EMPTY_SLOT){
+			here = slot;
+			return;
+		}
+		size_t hdist = probeDistance(pos, here.hash);
+		if(hdist < dist){
+			std::swap(here, slot);
+			dist = hdist;
+		}
+		pos = (pos + 1) & mask;
+		dist++;
+	}
+}
+
+void ResourceKeyIndex::rehash(const size_t slot_count){
+	vector<Slot> old;
+	old.swap(slots);
+	slots.resize(slot_count);
+	mask = slot_count - 1;
+	for (const Slot& slot : old){
+		if(slot.idx != EMPTY_SLOT) place(slot);
+	}
+}
+
+const size_t ResourceKeyIndex::find(const ResourceKey& key, const vector<ResourceKey>& keys) const{
+	size_t pos = findSlot(key, keys);
+	if(pos == SIZE_UNKNOWN) return SIZE_UNKNOWN;
+	return slots[pos].idx;
+}
+
+void ResourceKeyIndex::insert(const ResourceKey& key, const size_t idx){
+	reserve(count + 1);
+	Slot slot;
+	slot.idx = static_cast<u32>(idx);
+	slot.hash = hashKey(key);
+	place(slot);
+	count++;
+}
+
+void ResourceKeyIndex::erase(const ResourceKey& key, const vector<ResourceKey>& keys){
+	size_t pos = findSlot(key, keys);
+	if(pos == SIZE_UNKNOWN) return;
+
+	//Backward shift deletion - no tombstones
+	size_t next = (pos + 1) & mask;
+	while(slots[next].idx != EMPTY_SLOT && probeDistance(next, slots[next].hash) > 0){
+		slots[pos] = slots[next];
+		pos = next;
+		next = (next + 1) & mask;
+	}
+	slots[pos] = Slot();
+	count--;
+}
+
+void ResourceKeyIndex::remap(const ResourceKey& key, const vector<ResourceKey>& keys, const size_t new_idx){
+	size_t pos = findSlot(key, keys);
+	if(pos != SIZE_UNKNOWN) slots[pos].idx = static_cast<u32>(new_idx);
+}
+
+void ResourceKeyIndex::reserve(const size_t key_count){
+	//Keep load factor at or under 7/8
+	size_t need = key_count + key_count / 7 + 1;
+	if(need <= slots.size()) return;
+	size_t sz = slots.empty()?16:slots.size();
+	while(sz < need) sz <<= 1;
+	rehash(sz);
+}
+
+void ResourceKeyIndex::clear(){
+	slots.clear();
+	mask = 0;
+	count = 0;
+}
+
 /*--- Resource Map ---*/
 
+ResourceCard* ResourceMap::allocCard(){
+	if(!free_cards.empty()){
+		ResourceCard* card = free_cards.back();
+		free_cards.pop_back();
+		return card;
+	}
+	if(card_slots_used == card_blocks.size() * CARD_BLOCK_SIZE) card_blocks.emplace_back(new ResourceCard[CARD_BLOCK_SIZE]);
+	return &card_blocks.back()[card_slots_used++ % CARD_BLOCK_SIZE];
+}
+
+void ResourceMap::freeCard(ResourceCard* card){
+	*card = ResourceCard();
+	free_cards.push_back(card);
+}
+
+const size_t ResourceMap::lowerBound(const ResourceKey& key) const{
+	return std::lower_bound(rKeys.begin(), rKeys.end(), key) - rKeys.begin();
+}
+
+#ifdef WRCU_RESMAP_HASHED
+
+const size_t ResourceMap::findIndex(const ResourceKey& key) const{
+	return rIndex.find(key, rKeys);
+}
+
+ResourceCard* ResourceMap::insertAt(const size_t idx, const ResourceCard& card){
+	//Hashed mode always appends. idx is ignored.
+	ResourceCard* slot = allocCard();
+	*slot = card;
+	rKeys.push_back(card.key);
+	rCards.push_back(slot);
+	rIndex.insert(card.key, rKeys.size() - 1);
+	return slot;
+}
+
+#else
+
+const size_t ResourceMap::findIndex(const ResourceKey& key) const{
+	size_t idx = lowerBound(key);
+	if(idx >= rKeys.size() || rKeys[idx] != key) return SIZE_UNKNOWN;
+	return idx;
+}
+
+ResourceCard* ResourceMap::insertAt(const size_t idx, const ResourceCard& card){
+	ResourceCard* slot = allocCard();
+	*slot = card;
+	rKeys.insert(rKeys.begin() + idx, card.key);
+	rCards.insert(rCards.begin() + idx, slot);
+	return slot;
+}
+
+#endif
+
 ResourceCard& ResourceMap::getCard(u32 type, u32 group, u64 instance){
 	ResourceKey key = ResourceKey(type, group, instance);
 	return getCard(key);
 }
 
 ResourceCard& ResourceMap::getCard(ResourceKey& key){
-	try{
-		return rMap.at(key);
-	}
-	catch(std::out_of_range& ex){
-		throw NoResourceCardException("waffleoRai_Utils::ResourceMap::getCard", "Resource card with requested key not in map!", key);
-	}
+	size_t idx = findIndex(key);
+	if(idx == SIZE_UNKNOWN) throw NoResourceCardException("waffleoRai_Utils::ResourceMap::getCard", "Resource card with requested key not in map!", key);
+	return *rCards[idx];
 }
 
+#ifdef WRCU_RESMAP_HASHED
+
 const int ResourceMap::getAllCardsOfType(u32 type, list<ResourceCard>& target) const{
-	//TODO Copies to list?? Or referenced by list?
-	//map<ResourceKey, ResourceCard>::iterator itr;
 	int lcount = 0;
-	for (map<ResourceKey, ResourceCard>::const_iterator itr = rMap.begin(); itr != rMap.end(); itr++)
-	{
-		const ResourceKey& k = itr->first;
-		if(k.typeID == type)
-		{
-			target.push_back(itr->second);
-			lcount++;
-		}
+	for (size_t i = 0; i < rKeys.size(); i++){
+		if(rKeys[i].typeID != type) continue;
+		target.push_back(*rCards[i]);
+		lcount++;
 	}
 
 	return lcount;
 }
 
 const int ResourceMap::getAllCardsInGroup(u32 type, u32 group, list<ResourceCard>& target) const{
-	//TODO Copies to list?? Or referenced by list?
-	//map<ResourceKey, ResourceCard>::iterator itr;
 	int lcount = 0;
-	for (map<ResourceKey, ResourceCard>::const_iterator itr = rMap.begin(); itr != rMap.end(); itr++)
-	{
-		const ResourceKey& k = itr->first;
-		if((k.typeID == type) && (k.groupID == group))
-		{
-			target.push_back(itr->second);
-			lcount++;
-		}
+	for (size_t i = 0; i < rKeys.size(); i++){
+		if(rKeys[i].typeID != type || rKeys[i].groupID != group) continue;
+		target.push_back(*rCards[i]);
+		lcount++;
 	}
 
 	return lcount;
 }
 
-const int ResourceMap::getAllKeys(list<ResourceKey>& target) const{
-	map<ResourceKey, ResourceCard>::const_iterator itr;
+#else
+
+const int ResourceMap::getAllCardsOfType(u32 type, list<ResourceCard>& target) const{
+	//Keys sort by type first, so all cards of a type are one contiguous run
 	int lcount = 0;
-	for (itr = rMap.begin(); itr != rMap.end(); itr++)
-	{
-		const ResourceKey& k = itr->first;
-		target.push_back(k);
+	size_t i = lowerBound(ResourceKey(type, 0, 0ULL));
+	for (; i < rKeys.size() && rKeys[i].typeID == type; i++){
+		target.push_back(*rCards[i]);
 		lcount++;
 	}
 
 	return lcount;
 }
 
-const int ResourceMap::getAllCards(list<const ResourceCard*>& target) const{
-    map<ResourceKey, ResourceCard>::const_iterator itr;
+const int ResourceMap::getAllCardsInGroup(u32 type, u32 group, list<ResourceCard>& target) const{
 	int lcount = 0;
-	for (itr = rMap.begin(); itr != rMap.end(); itr++)
-	{
-		const ResourceCard* cptr = &(itr->second);
-		target.push_back(cptr);
+	size_t i = lowerBound(ResourceKey(type, group, 0ULL));
+	for (; i < rKeys.size() && rKeys[i].typeID == type && rKeys[i].groupID == group; i++){
+		target.push_back(*rCards[i]);
 		lcount++;
 	}
 
 	return lcount;
 }
 
+#endif
+
+const int ResourceMap::getAllKeys(list<ResourceKey>& target) const{
+	target.insert(target.end(), rKeys.begin(), rKeys.end());
+	return rKeys.size();
+}
+
+const int ResourceMap::getAllCards(list<const ResourceCard*>& target) const{
+	target.insert(target.end(), rCards.begin(), rCards.end());
+	return rCards.size();
+}
+
 const int ResourceMap::countCards() const{
-	return rMap.size();
+	return rCards.size();
 }
 
 const bool ResourceMap::hasCard(const ResourceKey& key) const{
-	//printf("KEY: %08x:%08x:%016llx\n", key.typeID, key.groupID, key.instanceID);
-	map<ResourceKey, ResourceCard>::const_iterator itr = rMap.find(key); //There is some issue with this - "invalid comparator???"
-	return(itr != rMap.end());
+	return findIndex(key) != SIZE_UNKNOWN;
+}
+
+ResourceCard* ResourceMap::findCard(const ResourceKey& key){
+	size_t idx = findIndex(key);
+	if(idx == SIZE_UNKNOWN) return nullptr;
+	return rCards[idx];
+}
+
+const ResourceCard* ResourceMap::findCard(const ResourceKey& key) const{
+	size_t idx = findIndex(key);
+	if(idx == SIZE_UNKNOWN) return nullptr;
+	return rCards[idx];
 }
 
 ResourceCard* ResourceMap::addCard(const ResourceKey& key) {
-	return &rMap[key];
+#ifdef WRCU_RESMAP_HASHED
+	size_t idx = findIndex(key);
+	if(idx != SIZE_UNKNOWN) return rCards[idx];
+#else
+	size_t idx = lowerBound(key);
+	if(idx < rKeys.size() && rKeys[idx] == key) return rCards[idx];
+#endif
+	ResourceCard card;
+	card.key = key;
+	return insertAt(idx, card);
 }
 
 ResourceCard* ResourceMap::addCard(const ResourceCard& card, const bool allow_overwrite){
-	if(!allow_overwrite && hasCard(card.key)) return nullptr;
-	rMap[card.key] = card;
-	return &(rMap[card.key]);
+#ifdef WRCU_RESMAP_HASHED
+	size_t idx = findIndex(card.key);
+	if(idx != SIZE_UNKNOWN){
+#else
+	size_t idx = lowerBound(card.key);
+	if(idx < rKeys.size() && rKeys[idx] == card.key){
+#endif
+		if(!allow_overwrite) return nullptr;
+		*rCards[idx] = card;
+		return rCards[idx];
+	}
+	return insertAt(idx, card);
 }
 
 const bool ResourceMap::removeCard(const ResourceKey& key){
-	size_t i = rMap.erase(key);
-	return (i == 1);
+	size_t idx = findIndex(key);
+	if(idx == SIZE_UNKNOWN) return false;
+	freeCard(rCards[idx]);
+#ifdef WRCU_RESMAP_HASHED
+	rIndex.erase(key, rKeys);
+	size_t last = rKeys.size() - 1;
+	if(idx != last){
+		rKeys[idx] = rKeys[last];
+		rCards[idx] = rCards[last];
+		rIndex.remap(rKeys[idx], rKeys, idx);
+	}
+	rKeys.pop_back();
+	rCards.pop_back();
+#else
+	rKeys.erase(rKeys.begin() + idx);
+	rCards.erase(rCards.begin() + idx);
+#endif
+	return true;
 }
 
 void ResourceMap::clearCards(){
-	rMap.clear();
+	rKeys.clear();
+	rCards.clear();
+	card_blocks.clear();
+	card_slots_used = 0;
+	free_cards.clear();
+	bulk_start = SIZE_UNKNOWN;
+#ifdef WRCU_RESMAP_HASHED
+	rIndex.clear();
+#endif
+}
+
+void ResourceMap::reserve(const size_t count){
+	rKeys.reserve(count);
+	rCards.reserve(count);
+	card_blocks.reserve((count + CARD_BLOCK_SIZE - 1) / CARD_BLOCK_SIZE);
+#ifdef WRCU_RESMAP_HASHED
+	rIndex.reserve(count);
+#endif
+}
+
+void ResourceMap::beginBulkInsert(const size_t count){
+	if(bulk_start == SIZE_UNKNOWN) bulk_start = rCards.size();
+	rCards.reserve(rCards.size() + count);
+	rKeys.reserve(rCards.size() + count);
+	card_blocks.reserve((card_slots_used + count + CARD_BLOCK_SIZE - 1) / CARD_BLOCK_SIZE);
+#ifdef WRCU_RESMAP_HASHED
+	rIndex.reserve(rCards.size() + count);
+#endif
+}
+
+ResourceCard& ResourceMap::bulkAppend(const ResourceKey& key){
+	if(bulk_start == SIZE_UNKNOWN) bulk_start = rCards.size();
+	ResourceCard* card = allocCard();
+	card->key = key;
+	rCards.push_back(card);
+	return *card;
+}
+
+ResourceCard& ResourceMap::bulkAppend(const ResourceCard& card){
+	if(bulk_start == SIZE_UNKNOWN) bulk_start = rCards.size();
+	ResourceCard* slot = allocCard();
+	*slot = card;
+	rCards.push_back(slot);
+	return *slot;
+}
+
+void ResourceMap::endBulkInsert(const bool allow_overwrite){
+	if(bulk_start == SIZE_UNKNOWN) return;
+	size_t old_count = bulk_start;
+	bulk_start = SIZE_UNKNOWN;
+	if(rCards.size() <= old_count) return;
+
+	//Only the index is reordered. Where a key was already mapped, its card keeps its address
+	//	and takes the new contents if overwriting; the slots of all other duplicates are freed.
+#ifdef WRCU_RESMAP_HASHED
+	size_t w = old_count;
+	size_t n = rCards.size();
+	for (size_t r = old_count; r < n; r++){
+		ResourceCard* card = rCards[r];
+		size_t j = rIndex.find(card->key, rKeys);
+		if(j == SIZE_UNKNOWN){
+			rCards[w] = card;
+			rKeys.push_back(card->key);
+			rIndex.insert(card->key, w);
+			w++;
+			continue;
+		}
+		if(j >= old_count || allow_overwrite) *rCards[j] = *card;
+		freeCard(card);
+	}
+	rCards.resize(w);
+#else
+	auto keyLess = [](const ResourceCard* a, const ResourceCard* b){ return a->key < b->key; };
+	vector<ResourceCard*>::iterator mid = rCards.begin() + old_count;
+
+	//Sort new run. Stable, so for duplicate keys within the run the last appended sorts last.
+	std::stable_sort(mid, rCards.end(), keyLess);
+
+	//Merge with the existing (already sorted) run. Existing cards stay ahead of new cards with equal keys.
+	if(old_count > 0) std::inplace_merge(rCards.begin(), mid, rCards.end(), keyLess);
+
+	//Collapse duplicate runs in one pass.
+	//	Within a run, [old card] precedes [new cards in append order].
+	size_t w = 0;
+	size_t n = rCards.size();
+	size_t r = 0;
+	while(r < n){
+		size_t e = r + 1;
+		while(e < n && rCards[e]->key == rCards[r]->key) e++;
+
+		//Last new card wins, unless the key was already mapped and overwrite is off.
+		//	rKeys still only indexes the old cards here, so it tells us whether the run head is an old card.
+		ResourceCard* keep = rCards[e - 1];
+		if(e - r > 1){
+			if(std::binary_search(rKeys.begin(), rKeys.end(), rCards[r]->key)){
+				keep = rCards[r];
+				if(allow_overwrite) *keep = *rCards[e - 1];
+				for (size_t i = r + 1; i < e; i++) freeCard(rCards[i]);
+			}
+			else{
+				for (size_t i = r; i < e - 1; i++) freeCard(rCards[i]);
+			}
+		}
+		rCards[w++] = keep;
+		r = e;
+	}
+	rCards.resize(w);
+
+	rKeys.clear();
+	rKeys.reserve(rCards.capacity());
+	for (const ResourceCard* card : rCards) rKeys.push_back(card->key);
+#endif
 }
 
 const int ResourceMap::copyIntoMap(ResourceMap& target, list<ResourceCard*>& output_list) const{
-    int ct = 0;
-    map<ResourceKey, ResourceCard>::const_iterator itr;
-	for (itr = rMap.begin(); itr != rMap.end(); itr++){
-		//okay = okay && target.addCard(itr->second);
-		ResourceCard* acard = target.addCard(itr->second, false);
-		if(acard != nullptr){
-          output_list.push_back(acard);
-          ct++;
-		}
+	//Merge everything in one pass. Card addresses are stable, so pointers can be collected as cards are appended.
+	int added = 0;
+	target.beginBulkInsert(rCards.size());
+	for (size_t i = 0; i < rCards.size(); i++){
+		if(target.hasCard(rKeys[i])) continue;
+		output_list.push_back(&target.bulkAppend(*rCards[i]));
+		added++;
 	}
-	return ct;
+	target.endBulkInsert(false);
+
+	return added;
 }
 
 }
@@ -5,12 +5,16 @@
 //============================================================================
 
 #include "FileStreamer.h"
+#include "restree.h"
+#include "lz77.h"
 
 #include <iostream>
 #include "unicode/ustdio.h"
 #include "unicode/ustream.h"
 #include <io.h>
 #include <fcntl.h>
+#include <chrono>
+#include <random>
 
 //using namespace std;
 using namespace waffleoRai_Utils;
@@ -127,6 +131,357 @@ void testUtilities() {
 	cout << "Utility Test End\n\n";
 }
 
+void benchResourceMapLookup(const int cardCount, const int lookupCount) {
+	//Compares ResourceMap exact-key lookup against a std::map keyed the same way (the old backend)
+	std::mt19937_64 rng(0x6d75456e);
+	vector<ResourceKey> keys;
+	keys.reserve(cardCount);
+	for (int i = 0; i < cardCount; i++) keys.push_back(ResourceKey(static_cast<u32>(rng() % 64), static_cast<u32>(rng()), rng()));
+
+	ResourceMap rmap;
+	std::map<ResourceKey, ResourceCard> smap;
+	rmap.beginBulkInsert(cardCount);
+	for (int i = 0; i < cardCount; i++) {
+		rmap.bulkAppend(keys[i]).offset = i;
+		smap[keys[i]].offset = i;
+	}
+	rmap.endBulkInsert(true);
+
+	vector<ResourceKey> queries;
+	queries.reserve(lookupCount);
+	for (int i = 0; i < lookupCount; i++) queries.push_back(keys[rng() % cardCount]);
+
+	u64 sum = 0;
+	auto t0 = std::chrono::steady_clock::now();
+	for (ResourceKey& k : queries) sum += smap.at(k).offset;
+	auto t1 = std::chrono::steady_clock::now();
+	for (ResourceKey& k : queries) sum -= rmap.getCard(k).offset;
+	auto t2 = std::chrono::steady_clock::now();
+
+	double ns_map = std::chrono::duration<double, std::nano>(t1 - t0).count() / lookupCount;
+	double ns_rmap = std::chrono::duration<double, std::nano>(t2 - t1).count() / lookupCount;
+#ifdef WRCU_RESMAP_HASHED
+	const char* mode = "hashed";
+#else
+	const char* mode = "sorted";
+#endif
+	printf("ResourceMap lookup (%d cards, %d lookups): std::map %.1f ns, ResourceMap (%s) %.1f ns\n", cardCount, lookupCount, ns_map, mode, ns_rmap);
+	if (sum != 0) cout << "ResourceMap lookup mismatch!\n";
+}
+
+void testResourceMapCards(const int cardCount) {
+	//Card pointers handed out must stay valid across later inserts, bulk merges and removal of other cards
+	std::mt19937_64 rng(0x72657354);
+	ResourceMap rmap;
+	std::map<ResourceKey, u64> ref;
+	std::map<ResourceKey, ResourceCard*> held;
+	int bad = 0;
+
+	for (int round = 0; round < 8; round++) {
+		const bool overwrite = (round & 1) != 0;
+		std::map<ResourceKey, bool> fresh;
+		rmap.beginBulkInsert(cardCount);
+		for (int i = 0; i < cardCount; i++) {
+			ResourceKey k(static_cast<u32>(rng() % 4), static_cast<u32>(rng() % 16), rng() % (cardCount * 2));
+			u64 v = rng();
+			rmap.bulkAppend(k).offset = v;
+			if (!fresh.count(k)) fresh[k] = ref.count(k) != 0;
+			if (overwrite || !fresh[k]) ref[k] = v;
+		}
+		rmap.endBulkInsert(overwrite);
+
+		for (int i = 0; i < cardCount / 8; i++) {
+			ResourceCard card;
+			card.key = ResourceKey(static_cast<u32>(rng() % 4), static_cast<u32>(rng() % 16), rng() % (cardCount * 2));
+			card.offset = rng();
+			if (rmap.addCard(card, overwrite) != nullptr) ref[card.key] = card.offset;
+		}
+
+		for (int i = 0; i < cardCount / 16 && !held.empty(); i++) {
+			auto itr = held.begin();
+			std::advance(itr, rng() % held.size());
+			if (!rmap.removeCard(itr->first)) bad++;
+			ref.erase(itr->first);
+			held.erase(itr);
+		}
+
+		for (int i = 0; i < 64; i++) {
+			auto itr = ref.begin();
+			std::advance(itr, rng() % ref.size());
+			held[itr->first] = rmap.findCard(itr->first);
+		}
+
+		for (auto& h : held) {
+			if (rmap.findCard(h.first) != h.second || h.second->key != h.first || h.second->offset != ref[h.first]) bad++;
+		}
+	}
+
+	if (rmap.countCards() != static_cast<int>(ref.size())) bad++;
+	for (auto& r : ref) {
+		const ResourceCard* card = rmap.findCard(r.first);
+		if (!card || card->offset != r.second) bad++;
+	}
+#ifndef WRCU_RESMAP_HASHED
+	//Sorted mode returns group members in key order
+	list<ResourceCard> group;
+	rmap.getAllCardsInGroup(1, 3, group);
+	auto itr = ref.lower_bound(ResourceKey(1, 3, 0ULL));
+	for (ResourceCard& card : group) {
+		if (itr == ref.end() || card.key != itr->first) { bad++; break; }
+		itr++;
+	}
+#endif
+
+	if (bad != 0) cout << "ResourceMap card test failed! (" << bad << " mismatches)\n";
+	else cout << "ResourceMap card test passed\n";
+}
+
+//Minimal LZ77 format for the tests: 0,byte for a literal | run,off0,off1,off2 for a back reference (off = distance - 1)
+class TestLZEncoder : public LZ77Compressor {
+protected:
+	const u32 encodeCost(const u32 run, const u32 /*offset*/) const override { return run > 0 ? 32 : 16; }
+	const int encodeToWriteBuffer() override {
+		if (streak_count == 0) {
+			write_buffer.put(0);
+			write_buffer.put(fwin.getByteAt(0));
+			return 1;
+		}
+		write_buffer.put(static_cast<ubyte>(streak_count));
+		write_buffer.put(static_cast<ubyte>(streak_off));
+		write_buffer.put(static_cast<ubyte>(streak_off >> 8));
+		write_buffer.put(static_cast<ubyte>(streak_off >> 16));
+		return static_cast<int>(streak_count);
+	}
+	const int encodeToBuffer(const ubyte* front, ubyte* out, const size_t outcap, size_t* written) override {
+		if (streak_count == 0) {
+			if (outcap < 2) return 0;
+			out[0] = 0;
+			out[1] = front[0];
+			*written = 2;
+			return 1;
+		}
+		if (outcap < 4) return 0;
+		out[0] = static_cast<ubyte>(streak_count);
+		out[1] = static_cast<ubyte>(streak_off);
+		out[2] = static_cast<ubyte>(streak_off >> 8);
+		out[3] = static_cast<ubyte>(streak_off >> 16);
+		*written = 4;
+		return static_cast<int>(streak_count);
+	}
+
+public:
+	TestLZEncoder(DataStreamerSource& src, size_t front_window_size, size_t back_window_size, LZParseMode mode = LZ_PARSE_GREEDY) :LZ77Compressor(src, front_window_size, back_window_size) {
+		global_streak_min = 3;
+		setParseMode(mode);
+	}
+
+	void setRunMinimums(const vector<LZCompRule>& rules) { streak_mins = rules; }
+};
+
+class TestLZDecoder : public LZ77Decompressor {
+protected:
+	const bool processNextCommand() override {
+		if (src.streamEnd()) return false;
+		const u32 run = src.nextByte();
+		if (run == 0) {
+			read_plain = 1;
+			backread_count = 0;
+			return true;
+		}
+		read_plain = 0;
+		backread_count = run;
+		u32 off = src.nextByte();
+		off |= static_cast<u32>(src.nextByte()) << 8;
+		off |= static_cast<u32>(src.nextByte()) << 16;
+		backread_off = off + 1;
+		return true;
+	}
+	const int decodeCommand(const ubyte* in, const size_t avail) override {
+		if (avail < 1) return 0;
+		if (in[0] == 0) {
+			read_plain = 1;
+			backread_count = 0;
+			return 1;
+		}
+		if (avail < 4) return 0;
+		read_plain = 0;
+		backread_count = in[0];
+		backread_off = (in[1] | (static_cast<u32>(in[2]) << 8) | (static_cast<u32>(in[3]) << 16)) + 1;
+		return 4;
+	}
+
+public:
+	TestLZDecoder(DataStreamerSource& src, size_t front_window_size, size_t back_window_size, size_t decompressedSize) :LZ77Decompressor(src, front_window_size, back_window_size, decompressedSize) {}
+};
+
+//Same formats without the flat hooks, so compressBuffer/decompressBuffer take the stream fallback
+class TestLZStreamEncoder : public TestLZEncoder {
+protected:
+	const int encodeToBuffer(const ubyte* /*front*/, ubyte* /*out*/, const size_t /*outcap*/, size_t* /*written*/) override { return -1; }
+
+public:
+	TestLZStreamEncoder(DataStreamerSource& src, size_t front_window_size, size_t back_window_size, LZParseMode mode = LZ_PARSE_GREEDY) :TestLZEncoder(src, front_window_size, back_window_size, mode) {}
+};
+
+class TestLZStreamDecoder : public TestLZDecoder {
+protected:
+	const int decodeCommand(const ubyte* /*in*/, const size_t /*avail*/) override { return -1; }
+
+public:
+	TestLZStreamDecoder(DataStreamerSource& src, size_t front_window_size, size_t back_window_size, size_t decompressedSize) :TestLZDecoder(src, front_window_size, back_window_size, decompressedSize) {}
+};
+
+const vector<ubyte> lzTestInput(const size_t size) {
+	//Words, noise, and short-period repeats (so runs overlap their own output)
+	const char* words[9] = { "the ", "quick ", "brown ", "fox ", "jumps ", "over ", "lazy ", "dog ", "\n" };
+	std::mt19937 rng(0x6c7a3737);
+	vector<ubyte> in;
+	in.reserve(size + 256);
+	while (in.size() < size) {
+		const int k = rng() % 20;
+		if (k < 12) {
+			const char* w = words[rng() % 9];
+			in.insert(in.end(), w, w + strlen(w));
+		}
+		else if (k < 15) in.push_back(static_cast<ubyte>(rng()));
+		else {
+			const size_t len = rng() % 200;
+			const size_t period = 1 + rng() % 5;
+			for (size_t i = 0; i < len; i++) in.push_back(static_cast<ubyte>("abcde"[i % period]));
+		}
+	}
+	in.resize(size);
+	return in;
+}
+
+const vector<ubyte> lzDecodeStream(const vector<ubyte>& comp, const size_t size) {
+	MemInputStreamer input(comp.data(), comp.size());
+	input.open();
+	TestLZDecoder dec(input, 0x200, 0x1000, size);
+	vector<ubyte> out;
+	while (!dec.streamEnd() && out.size() < size) out.push_back(dec.nextByte());
+	return out;
+}
+
+void testLZ77(const size_t size) {
+	//Greedy hash chain search, bounded and exhaustive. Every run has to meet the LZCompRule minimum for its offset.
+	//Then every parse mode round trips, and optimal parsing can't cost more than greedy by encodeCost.
+	//Decoding mixes single bytes with spans, and decodeInto can hand off to the stream part way.
+	//compressBuffer/decompressBuffer have to match the stream exactly, on both the flat path and the stream fallback.
+	//Block compression, reset or primed, has to decode as one stream whatever the worker count.
+	const size_t fwin = 255;
+	const size_t bwin = 0x1000;
+	const vector<ubyte> in = lzTestInput(size);
+	const vector<LZCompRule> rules = { LZCompRule(0x100, 4), LZCompRule(0x800, 6) };
+
+	int bad = 0;
+	for (u32 depth : { static_cast<u32>(LZ77_DEFO_CHAIN_DEPTH), 0u }) {
+		for (int r = 0; r < 2; r++) {
+			MemInputStreamer input(in.data(), in.size());
+			input.open();
+			TestLZEncoder enc(input, fwin, bwin);
+			enc.setMaxChainDepth(depth);
+			if (r) enc.setRunMinimums(rules);
+			vector<ubyte> comp;
+			while (!enc.streamEnd()) comp.push_back(enc.nextByte());
+
+			size_t i = 0;
+			while (i < comp.size()) {
+				if (comp[i] == 0) {
+					i += 2;
+					continue;
+				}
+				const u32 off = comp[i + 1] | (static_cast<u32>(comp[i + 2]) << 8) | (static_cast<u32>(comp[i + 3]) << 16);
+				u32 minrun = 3;
+				for (const LZCompRule& rule : rules) {
+					if (r && off >= rule.max_offset) minrun = rule.max_run;
+				}
+				if (comp[i] < minrun || off >= bwin) bad++;
+				i += 4;
+			}
+			if (lzDecodeStream(comp, size) != in) bad++;
+			printf("LZ77 greedy (chain depth %u%s): %zu -> %zu bytes\n", depth, r ? ", run rules" : "", size, comp.size());
+		}
+	}
+
+	const char* modenames[3] = { "greedy", "lazy", "optimal" };
+	const LZParseMode modes[3] = { LZ_PARSE_GREEDY, LZ_PARSE_LAZY, LZ_PARSE_OPTIMAL };
+	u64 costs[3];
+	std::mt19937 rng(0x6c7a3738);
+	vector<ubyte> out(size);
+	vector<ubyte> comp(size * 2 + 16);
+	for (int m = 0; m < 3; m++) {
+		vector<ubyte> ref;
+		MemInputStreamer input(in.data(), in.size());
+		input.open();
+		TestLZEncoder enc(input, fwin, bwin, modes[m]);
+		while (!enc.streamEnd()) ref.push_back(enc.nextByte());
+
+		costs[m] = 0;
+		size_t i = 0;
+		while (i < ref.size()) {
+			costs[m] += ref[i] == 0 ? 16 : 32;
+			i += ref[i] == 0 ? 2 : 4;
+		}
+		if (lzDecodeStream(ref, size) != in) bad++;
+
+		MemInputStreamer cinput(ref.data(), ref.size());
+		cinput.open();
+		TestLZDecoder dec(cinput, 0x200, bwin, in.size());
+		std::fill(out.begin(), out.end(), 0);
+		size_t n = 0;
+		while (!dec.streamEnd() && n < size) {
+			if (n & 1) out[n++] = dec.nextByte();
+			else n += dec.nextBytes(out.data() + n, std::min<size_t>(rng() % 5000 + 1, size - n));
+		}
+		if (n != size || out != in) bad++;
+
+		MemInputStreamer pinput(ref.data(), ref.size());
+		pinput.open();
+		TestLZDecoder pdec(pinput, 0x200, bwin, in.size());
+		std::fill(out.begin(), out.end(), 0);
+		n = pdec.decodeInto(out.data(), size / 3);
+		n += pdec.nextBytes(out.data() + n, size - n);
+		if (n != size || out != in) bad++;
+
+		for (int flat = 0; flat < 2; flat++) {
+			const size_t clen = flat ? LZ77Compressor::compressBuffer<TestLZEncoder>(in.data(), in.size(), comp.data(), comp.size(), fwin, bwin, modes[m])
+				: LZ77Compressor::compressBuffer<TestLZStreamEncoder>(in.data(), in.size(), comp.data(), comp.size(), fwin, bwin, modes[m]);
+			if (clen != ref.size() || memcmp(comp.data(), ref.data(), clen) != 0) bad++;
+			const size_t slen = flat ? LZ77Compressor::compressBuffer<TestLZEncoder>(in.data(), in.size(), comp.data(), clen / 2, fwin, bwin, modes[m])
+				: LZ77Compressor::compressBuffer<TestLZStreamEncoder>(in.data(), in.size(), comp.data(), clen / 2, fwin, bwin, modes[m]);
+			if (slen != 0) bad++;
+
+			std::fill(out.begin(), out.end(), 0);
+			n = flat ? LZ77Decompressor::decompressBuffer<TestLZDecoder>(ref.data(), ref.size(), out.data(), out.size(), static_cast<size_t>(0x200), bwin, in.size())
+				: LZ77Decompressor::decompressBuffer<TestLZStreamDecoder>(ref.data(), ref.size(), out.data(), out.size(), static_cast<size_t>(0x200), bwin, in.size());
+			if (n != size || out != in) bad++;
+
+			//Short destination only gets a correct prefix
+			std::fill(out.begin(), out.end(), 0);
+			n = flat ? LZ77Decompressor::decompressBuffer<TestLZDecoder>(ref.data(), ref.size(), out.data(), 1000, static_cast<size_t>(0x200), bwin, in.size())
+				: LZ77Decompressor::decompressBuffer<TestLZStreamDecoder>(ref.data(), ref.size(), out.data(), 1000, static_cast<size_t>(0x200), bwin, in.size());
+			if (n > 1000 || memcmp(out.data(), in.data(), n) != 0 || out[1000] != 0) bad++;
+		}
+		printf("LZ77 %s: %zu -> %zu bytes (cost %llu)\n", modenames[m], size, ref.size(), (unsigned long long)costs[m]);
+	}
+	if (costs[2] > costs[0]) bad++;
+
+	for (int prime = 0; prime < 2; prime++) {
+		for (int workers : { 1, 4 }) {
+			const size_t blen = LZ77Compressor::compressBlocks<TestLZEncoder>(in.data(), in.size(), comp.data(), comp.size(), 0x3333, prime != 0, workers, fwin, bwin, LZ_PARSE_LAZY);
+			std::fill(out.begin(), out.end(), 0);
+			const size_t dlen = LZ77Decompressor::decompressBuffer<TestLZDecoder>(comp.data(), blen, out.data(), out.size(), static_cast<size_t>(0x200), bwin, in.size());
+			if (blen == 0 || dlen != size || out != in) bad++;
+			printf("LZ77 blocks (prime %d, %d workers): %zu bytes\n", prime, workers, blen);
+		}
+	}
+	if (LZ77Compressor::compressBlocks<TestLZEncoder>(in.data(), in.size(), comp.data(), 100, 0x3333, true, 2, fwin, bwin, LZ_PARSE_LAZY) != 0) bad++;
+
+	if (bad != 0) cout << "LZ77 test failed! (" << bad << " mismatches)\n";
+	else cout << "LZ77 test passed\n";
+}
+
 void testUnicodePaths(string& testdir) {
 
 	string unicodelist = testdir + "\\filenames.txt";
@@ -441,6 +796,9 @@ int main(void)
 	string testdir = "D:\\usr\\bghos\\code\\test";
 	try{
 		testUtilities();
+		testResourceMapCards(2000);
+		benchResourceMapLookup(100000, 1000000);
+		testLZ77(0x80000);
 		testFileStreamer(testdir);
 	}
 	catch(exception& e){cout << "Uncaught exception: \n" << e.what() << "\n"; return 1;}
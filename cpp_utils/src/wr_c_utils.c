@@ -1,6 +1,22 @@
 
 #include "wr_c_utils.h"
 
+//SSSE3 is not in the x86-64 baseline, so it is compiled per function and checked for at runtime.
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#	include <tmmintrin.h>
+#	define WRCU_SIMD_SSSE3
+#	ifdef _MSC_VER
+#		include <intrin.h>
+#		define WRCU_TARGET_SSSE3
+#	else
+#		include <cpuid.h>
+#		define WRCU_TARGET_SSSE3 __attribute__((target("ssse3")))
+#	endif
+#elif defined(__ARM_NEON)
+#	include <arm_neon.h>
+#	define WRCU_SIMD_NEON
+#endif
+
 //Number/String conversion
 
 const char16_t FILE_SEP16 = (const char16_t)FILE_SEP;
@@ -157,3 +173,93 @@ void wrcu_reverseBytes(uint8_t* ptr, const int nbytes) {
     }
 
 }
+
+//Array byte swaps. The SIMD paths do 16 bytes per step, then the scalar loop mops up the tail.
+
+#if defined(WRCU_SIMD_SSSE3)
+static const uint8_t WRCU_SHUF_BSWAP16[16] = {1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14};
+static const uint8_t WRCU_SHUF_BSWAP32[16] = {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12};
+static const uint8_t WRCU_SHUF_BSWAP64[16] = {7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8};
+
+static int wrcu_ssse3_detected = -1;
+
+static const boolean wrcu_cpu_has_ssse3() {
+    if (wrcu_ssse3_detected < 0) {
+#ifdef _MSC_VER
+        int regs[4];
+        __cpuid(regs, 1);
+        wrcu_ssse3_detected = (regs[2] >> 9) & 1;
+#else
+        unsigned int a, b, c, d;
+        wrcu_ssse3_detected = __get_cpuid(1, &a, &b, &c, &d) ? (int)((c >> 9) & 1) : 0;
+#endif
+    }
+    return (boolean)wrcu_ssse3_detected;
+}
+
+//Returns the number of bytes shuffled (a multiple of 16)
+WRCU_TARGET_SSSE3 static size_t wrcu_shuffle_ssse3(uint8_t* ptr, const size_t nbytes, const uint8_t* table) {
+    const __m128i shuf = _mm_loadu_si128((const __m128i*)table);
+    size_t i = 0;
+    for (; i + 16 <= nbytes; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(ptr + i));
+        _mm_storeu_si128((__m128i*)(ptr + i), _mm_shuffle_epi8(v, shuf));
+    }
+    return i;
+}
+#endif
+
+void wrcu_reverseBytes16Array(uint16_t* ptr, const size_t count) {
+    size_t i = 0;
+    if (!ptr) return;
+#if defined(WRCU_SIMD_SSSE3)
+    if (wrcu_cpu_has_ssse3()) i = wrcu_shuffle_ssse3((uint8_t*)ptr, count << 1, WRCU_SHUF_BSWAP16) >> 1;
+#elif defined(WRCU_SIMD_NEON)
+    for (; i + 8 <= count; i += 8) {
+        uint8x16_t v = vld1q_u8((const uint8_t*)(ptr + i));
+        vst1q_u8((uint8_t*)(ptr + i), vrev16q_u8(v));
+    }
+#endif
+    for (; i < count; i++) {
+        uint16_t v = ptr[i];
+        ptr[i] = (uint16_t)((v >> 8) | (v << 8));
+    }
+}
+
+void wrcu_reverseBytes32Array(uint32_t* ptr, const size_t count) {
+    size_t i = 0;
+    if (!ptr) return;
+#if defined(WRCU_SIMD_SSSE3)
+    if (wrcu_cpu_has_ssse3()) i = wrcu_shuffle_ssse3((uint8_t*)ptr, count << 2, WRCU_SHUF_BSWAP32) >> 2;
+#elif defined(WRCU_SIMD_NEON)
+    for (; i + 4 <= count; i += 4) {
+        uint8x16_t v = vld1q_u8((const uint8_t*)(ptr + i));
+        vst1q_u8((uint8_t*)(ptr + i), vrev32q_u8(v));
+    }
+#endif
+    for (; i < count; i++) {
+        uint32_t v = ptr[i];
+        ptr[i] = (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+    }
+}
+
+void wrcu_reverseBytes64Array(uint64_t* ptr, const size_t count) {
+    size_t i = 0;
+    if (!ptr) return;
+#if defined(WRCU_SIMD_SSSE3)
+    if (wrcu_cpu_has_ssse3()) i = wrcu_shuffle_ssse3((uint8_t*)ptr, count << 3, WRCU_SHUF_BSWAP64) >> 3;
+#elif defined(WRCU_SIMD_NEON)
+    for (; i + 2 <= count; i += 2) {
+        uint8x16_t v = vld1q_u8((const uint8_t*)(ptr + i));
+        vst1q_u8((uint8_t*)(ptr + i), vrev64q_u8(v));
+    }
+#endif
+    for (; i < count; i++) {
+        uint64_t v = ptr[i];
+        uint32_t hi = (uint32_t)(v >> 32);
+        uint32_t lo = (uint32_t)v;
+        hi = (hi >> 24) | ((hi >> 8) & 0xff00) | ((hi << 8) & 0xff0000) | (hi << 24);
+        lo = (lo >> 24) | ((lo >> 8) & 0xff00) | ((lo << 8) & 0xff0000) | (lo << 24);
+        ptr[i] = ((uint64_t)lo << 32) | hi;
+    }
+}
@@ -6,11 +6,19 @@
 #include "quickDefs.h"
 #include "muenDefs.h"
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #define AES_KEYBYTES_128 16
 #define AES_KEYSLOTS_128 11
 #define AES_ROUNDS_128 9
+#define AES_RKWORDS_128 44
+
+//Block kernels selectable with aes_set_kernel
+#define AES_KERNEL_REFERENCE 0
+#define AES_KERNEL_TTABLE 1
+#define AES_KERNEL_AESNI 2 //x86 AES-NI
+#define AES_KERNEL_ARMCE 3 //ARMv8 Crypto Extensions
 
 #ifdef __cplusplus
 extern "C" {
@@ -22,15 +30,27 @@ extern "C" {
     WRMUENAM_DLL_API extern const int32_t AES_SHIFT_ROWS_MAP[16];
 
     WRMUENAM_DLL_API extern boolean AES_TABLESINIT;
-    WRMUENAM_DLL_API int32_t AES_RCON[256];
-    WRMUENAM_DLL_API int32_t AES_SBOX[256];
-    WRMUENAM_DLL_API int32_t AES_SBOXINV[256];
+    WRMUENAM_DLL_API extern int32_t AES_RCON[256];
+    WRMUENAM_DLL_API extern int32_t AES_SBOX[256];
+    WRMUENAM_DLL_API extern int32_t AES_SBOXINV[256];
+
+    //Round lookup tables for the T-table kernel. Built by aes_init_common_tables.
+    WRMUENAM_DLL_API extern uint32_t AES_TTBL_ENC[4][256];
+    WRMUENAM_DLL_API extern uint32_t AES_TTBL_DEC[4][256];
+    WRMUENAM_DLL_API extern ubyte AES_SBOX8[256];
+    WRMUENAM_DLL_API extern ubyte AES_SBOXINV8[256];
 
 typedef struct WRMUENAM_DLL_API aes_key128{
 
     ubyte aes_key[AES_KEYBYTES_128];
     ubyte key_sched[AES_KEYSLOTS_128* AES_KEYBYTES_128];
 
+    ubyte dec_sched[AES_KEYSLOTS_128* AES_KEYBYTES_128]; //Equivalent inverse cipher schedule (for hardware kernels)
+
+    //Same schedules as big-endian words (for T-table kernel)
+    uint32_t enc_rk[AES_RKWORDS_128];
+    uint32_t dec_rk[AES_RKWORDS_128];
+
     boolean is_init;
 
 } aes_key128_t;
@@ -39,6 +59,7 @@ typedef struct WRMUENAM_DLL_API aes_state128{
 
     aes_key128_t* key;
     ubyte* vec;
+    ubyte ivbuff[AES_KEYBYTES_128]; //Multi-block calls leave vec pointing here, since src may be overwritten in place
 
 } aes_state128_t;
 
@@ -58,8 +79,19 @@ WRMUENAM_DLL_API const int32_t WRMUENAM_CDECL aes_gmul(int32_t a, int32_t b);
 WRMUENAM_DLL_API const int WRMUENAM_CDECL rijndael_enc(aes_key128_t* key, ubyte* src, ubyte* dst);
 WRMUENAM_DLL_API const int WRMUENAM_CDECL rijndael_dec(aes_key128_t* key, ubyte* src, ubyte* dst);
 
+//rijndael_enc/dec dispatch to the active kernel. Kernels can also be called directly.
+WRMUENAM_DLL_API const int WRMUENAM_CDECL aes_set_kernel(const int kernel); //Returns kernel now active
+WRMUENAM_DLL_API const int WRMUENAM_CDECL aes_get_kernel();
+WRMUENAM_DLL_API const boolean WRMUENAM_CDECL aes_kernel_supported(const int kernel);
+WRMUENAM_DLL_API const int WRMUENAM_CDECL rijndael_enc_ref(aes_key128_t* key, ubyte* src, ubyte* dst);
+WRMUENAM_DLL_API const int WRMUENAM_CDECL rijndael_dec_ref(aes_key128_t* key, ubyte* src, ubyte* dst);
+WRMUENAM_DLL_API const int WRMUENAM_CDECL rijndael_enc_ttbl(aes_key128_t* key, ubyte* src, ubyte* dst);
+WRMUENAM_DLL_API const int WRMUENAM_CDECL rijndael_dec_ttbl(aes_key128_t* key, ubyte* src, ubyte* dst);
+
 WRMUENAM_DLL_API const int WRMUENAM_CDECL aes_encblock_cbc128(ubyte* src, ubyte* dst, aes_state128_t* state);
 WRMUENAM_DLL_API const int WRMUENAM_CDECL aes_decblock_cbc128(ubyte* src, ubyte* dst, aes_state128_t* state);
+WRMUENAM_DLL_API const size_t WRMUENAM_CDECL aes_encblocks_cbc128(const ubyte* src, ubyte* dst, const size_t bcount, aes_state128_t* state); //src may == dst
+WRMUENAM_DLL_API const size_t WRMUENAM_CDECL aes_decblocks_cbc128(ubyte* src, ubyte* dst, const size_t bcount, aes_state128_t* state); //src may == dst
 
 WRMUENAM_DLL_API const size_t WRMUENAM_CDECL aes_enc_cbc128(ubyte* src, ubyte* dst, const size_t length, ubyte* key, ubyte* iv);
 WRMUENAM_DLL_API const size_t WRMUENAM_CDECL aes_dec_cbc128(ubyte* src, ubyte* dst, const size_t length, ubyte* key, ubyte* iv);
@@ -6,6 +6,8 @@
 #include "FileStreamer.h"
 #include "aes_c.h"
 
+#define MUENAES_WINDOW_SIZE 0x4000
+
 using namespace waffleoRai_Utils;
 
 namespace waffleoRai_muengine{
@@ -14,38 +16,49 @@ class WRMUENAM_DLL_API MuenDecryptStream:public DataStreamerSource{
 
 private:
     DataStreamerSource& input;
-    ubyte buffer[48];
+    ubyte init_vec[16]; //Kept for seeks back into block 0
 
-    ubyte* vec;
-    ubyte* ibuff;
-    ubyte* obuff;
-    int opos;
+    //Plaintext window. Ciphertext is read straight into it in whole blocks and decrypted in place.
+    const size_t window_sz;
+    ubyte* window;
+    ubyte* win_p0;
+    ubyte* win_p1;
+    size_t pos_p1; //Stream position of win_p1 (the next ciphertext byte to be read from the source)
+    streampos base_pos; //Source position at open, which is stream position 0
+    size_t plain_sz; //Plaintext length if the ciphertext is padded, otherwise SIZE_UNKNOWN
 
     aes_state128_t aes_state;
 
     bool delsrc_on_close;
     bool is_open;
+    bool src_dry; //Source returned less than a full read
 
-    const bool nextBlock();
+    const size_t decryptInto(ubyte* dst, const size_t maxlen);
+    const bool fillWindow();
 
 public:
-    MuenDecryptStream(DataStreamerSource& src, aes_key128_t* key, ubyte* init_vec):input(src),opos(0), delsrc_on_close(false),is_open(false){
+    MuenDecryptStream(DataStreamerSource& src, aes_key128_t* key, ubyte* iv, const size_t window_size = MUENAES_WINDOW_SIZE):input(src),
+        window_sz(window_size < 16 ? 16 : (window_size & ~(size_t)0xf)),window(nullptr),win_p0(nullptr),win_p1(nullptr),
+        pos_p1(0),base_pos(0),plain_sz(SIZE_UNKNOWN),delsrc_on_close(false),is_open(false),src_dry(false){
+        memcpy(init_vec, iv, 16);
+        memset(&aes_state, 0, sizeof(aes_state128_t));
         aes_state.key = key;
-        memcpy(buffer, init_vec, 16);
-        aes_state.vec = buffer;
-
-        vec = buffer;
-        ibuff = buffer+16;
-        obuff = buffer+32;
-
-        memset(ibuff, 0, 16);
-        memset(obuff, 0, 16);
+        aes_state.vec = init_vec;
     }
 
+    const int get() override;
     const ubyte nextByte() override;
+    const size_t nextBytes(ubyte* dst, const size_t len) override;
+    const size_t peekSpan(const ubyte** span, const size_t len) override;
+    const size_t consume(const size_t len) override;
+	const bool remainingToEndKnown() const override{return src_dry || plain_sz != SIZE_UNKNOWN || input.remainingToEndKnown();}
 	const size_t remaining() const override;
 	const bool streamEnd() const override;
 
+	const bool isSeekable() const override{return input.isSeekable();}
+	const streampos seek(const streampos pos) override;
+	const streampos tell() override;
+
 	void open() override;
 	void close() override;
 	const bool isOpen() const override{return is_open;}
@@ -53,6 +66,9 @@ public:
 	const bool deleteSourceOnClose() const{return delsrc_on_close;}
 	void setDeleteSourceOnClose(bool flag){delsrc_on_close = flag;}
 
+	//End the stream after this many plaintext bytes, so block padding isn't returned as data
+	void setPlainSize(const size_t size){plain_sz = size;}
+
     virtual ~MuenDecryptStream(){close();}
 
 };
@@ -61,32 +77,30 @@ class WRMUENAM_DLL_API MuenEncryptStream:public DataOutputTarget{
 
 private:
     DataOutputTarget& output;
-    ubyte buffer[48];
+    ubyte init_vec[16];
 
-    ubyte* vec;
-    ubyte* ibuff;
-    ubyte* obuff;
-    int opos;
+    ubyte ibuff[16]; //Incomplete trailing block
+    int ipos;
+
+    //Ciphertext staging, written to the target in one call per fill
+    const size_t obuff_sz;
+    ubyte* obuffer;
 
     aes_state128_t aes_state;
 
     bool deltrg_on_close;
     bool is_open;
 
-    const bool flushOutput();
+    const bool encryptBlocks(const ubyte* src, const size_t bcount);
 
 public:
-    MuenEncryptStream(DataOutputTarget& trg, aes_key128_t* key, ubyte* init_vec):output(trg),opos(0), deltrg_on_close(false),is_open(false){
-        aes_state.key = key;
-        memcpy(buffer, init_vec, 16);
-        aes_state.vec = buffer;
-
-        vec = buffer;
-        ibuff = buffer+16;
-        obuff = buffer+32;
-
+    MuenEncryptStream(DataOutputTarget& trg, aes_key128_t* key, ubyte* iv, const size_t buffer_size = MUENAES_WINDOW_SIZE):output(trg),ipos(0),
+        obuff_sz(buffer_size < 16 ? 16 : (buffer_size & ~(size_t)0xf)),obuffer(nullptr),deltrg_on_close(false),is_open(false){
+        memcpy(init_vec, iv, 16);
         memset(ibuff, 0, 16);
-        memset(obuff, 0, 16);
+        memset(&aes_state, 0, sizeof(aes_state128_t));
+        aes_state.key = key;
+        aes_state.vec = init_vec;
     }
 
     const bool addByte(ubyte b) override;
@@ -1,10 +1,18 @@
 #ifndef MUENAM_H_INCLUDED
 #define MUENAM_H_INCLUDED
 
+#include <mutex>
+#include <shared_mutex>
+#include <future>
+#include <memory>
+#include <optional>
+
 #include "restree.h"
 #include "muenDefs.h"
 #include "muenaes.h"
 #include "muenzip.h"
+#include "muenzstd.h"
+#include "muenlz4.h"
 #include "muenam_formats.h"
 
 #define MUENCORE_SETBIN_VERSION 1
@@ -22,6 +30,7 @@ namespace waffleoRai_muengine{
     const char16_t FNAME_INSTREG[9] = {'i','n','s','t','.','r','e','g','\0'};
     const char16_t FNAME_INIBIN[9] = { 'i','n','i','t','.','b','i','n','\0' };
     const char16_t FNAME_INICFG[9] = { 'i','n','i','t','.','c','f','g','\0' };
+    const char FNAME_MASTERASSH[12] = "master.assh"; //Relative to install root. Only used by ALL_ON_BOOT model.
 
     enum e_cardloading_model :uint16_t {
 
@@ -56,19 +65,28 @@ private:
 
     ubyte xorkey[16];
     int pos;
+    streampos base_pos; //Source position at open, which is stream position 0 (and key phase 0)
 
     bool delsrc_on_close;
     bool is_open;
 
 public:
-    MuenDexorStream(DataStreamerSource& src, ubyte* xkey):input(src),pos(0),delsrc_on_close(false),is_open(false){
+    MuenDexorStream(DataStreamerSource& src, ubyte* xkey):input(src),pos(0),base_pos(0),delsrc_on_close(false),is_open(false){
         memcpy(xorkey, xkey, 16);
     }
 
+    const int get() override;
     const ubyte nextByte() override;
+    const size_t nextBytes(ubyte* dst, const size_t len) override;
+    const size_t consume(const size_t len) override;
+	const bool remainingToEndKnown() const override{return input.remainingToEndKnown();}
 	const size_t remaining() const override;
 	const bool streamEnd() const override;
 
+	const bool isSeekable() const override{return input.isSeekable();}
+	const streampos seek(const streampos pos) override;
+	const streampos tell() override;
+
 	void open() override;
 	void close() override;
 	const bool isOpen() const override{return is_open;}
@@ -106,6 +124,67 @@ public:
     virtual ~MuenXorStream(){close();}
 };
 
+//Decode pipeline for one open resource: file window -> decrypt -> dexor -> decompress -> reader.
+//  Stages that don't apply are left empty. Stages are built in place and chains are pooled by the AssetManager,
+//  so opening a resource doesn't heap allocate stream objects.
+typedef struct ResourceStreamChain{
+    aes_key128_t key; //Per-resource key (master xor TGI), only set up if encrypted
+    std::optional<MmapInputStreamer> window;
+    std::optional<MuenDecryptStream> decrypt;
+    std::optional<MuenDexorStream> dexor;
+    std::optional<MuenUnzipStream> unzip;
+    std::optional<MuenParallelUnzipStream> punzip;
+#ifdef MUENAM_USE_ZSTD
+    std::optional<MuenUnzstdStream> unzstd;
+#endif
+#ifdef MUENAM_USE_LZ4
+    std::optional<MuenUnlz4Stream> unlz4;
+#endif
+    std::optional<DataInputStreamer> reader;
+    bool in_use = false;
+
+    void reset();
+} ResourceStreamChain;
+
+class AssetManager;
+
+//Reader for a resource opened with AssetManager::openResource. Move-only.
+//  Its decode chain goes back to the manager's pool when the reader is closed or destroyed.
+class ResourceReader{
+
+private:
+    AssetManager* owner;
+    DataInputStreamer* reader;
+
+public:
+    ResourceReader():owner(nullptr),reader(nullptr){}
+    ResourceReader(AssetManager* mgr, DataInputStreamer* rdr):owner(mgr),reader(rdr){}
+    ResourceReader(const ResourceReader& other) = delete;
+    ResourceReader& operator=(const ResourceReader& other) = delete;
+    ResourceReader(ResourceReader&& other) noexcept:owner(other.owner),reader(other.reader){
+        other.owner = nullptr;
+        other.reader = nullptr;
+    }
+    ResourceReader& operator=(ResourceReader&& other) noexcept;
+
+    const bool isOpen() const{return reader != nullptr;}
+    DataInputStreamer& get(){return *reader;}
+    DataInputStreamer& operator*(){return *reader;}
+    DataInputStreamer* operator->(){return reader;}
+    void close();
+
+    ~ResourceReader(){close();}
+};
+
+//Group ASSH load state (BY_GROUP model). Cards are parsed into their own map (possibly on a worker thread)
+//  and only merged into the main map by the thread that first needs them.
+typedef struct AsshGroupLoad{
+    ResourceMap cards; //Staging map, emptied once merged
+    std::shared_future<bool> parsed; //Declared after cards so a pending parse is waited on before cards is destroyed
+    bool merged = false;
+    bool okay = false;
+} AsshGroupLoad;
+
 class AssetManager{
 
 private:
@@ -138,6 +217,26 @@ private:
     uint64_t mem_usage = 0L;
     uint64_t max_mem;
 
+    std::shared_mutex card_lock; //Guards res_map. Lookups take it shared, group merges take it exclusive.
+    std::mutex stream_lock; //Guards assp_maps and stream_pool
+    map<const path*, std::unique_ptr<FileMapping>> assp_maps; //Keyed by path table entry. Must outlive stream_pool.
+    MuenInflatePool inflate_pool; //Shared by every unzip stage. Must outlive stream_pool.
+    MuenWorkerPool unzip_workers; //Runs chunked inflate jobs for every stream and loadResourceInto. Must outlive stream_pool.
+    vector<std::unique_ptr<ResourceStreamChain>> stream_pool;
+
+    //Keep at end of members - destroying this waits on any running prefetch, which reads the members above.
+    std::mutex group_lock; //Guards group_loads. Taken before card_lock when both are needed.
+    map<uint32_t, std::unique_ptr<AsshGroupLoad>> group_loads;
+
+    const bool readASSH(DataStreamerSource& src, ResourceMap& target);
+    const bool readASSHFile(const path& fullpath, ResourceMap& target);
+    AsshGroupLoad* startGroupLoad(const uint32_t gid, const std::launch policy);
+    FileMapping& getPackageMapping(const path& assp_path);
+    const bool copyResourceCard(const ResourceKey& key, ResourceCard& dst);
+    void closeResource(DataInputStreamer& reader);
+
+    friend class ResourceReader;
+
 public:
     AssetManager(const uint64_t maxmem, const bool readonly):settings(),res_map(),
         max_mem(maxmem),is_mutable(readonly),group_paths(),loaded_res(), pathtbl(16){
@@ -148,9 +247,16 @@ public:
 
     AssetManager(const UnicodeString& inibin_path, const bool readonly);
 
-    void setRootPath(UnicodeString& path) { pathtbl.setBasePath(path); }
+    void setRootPath(const UnicodeString& path);
+    const e_cardloading_model getCardLoadingModel() const { return cloadmdl; }
+
+    ResourceReader openResource(const ResourceKey& key); //The decode chain is returned to the pool when the reader goes out of scope
+    const size_t loadResourceInto(const ResourceKey& key, void* dst, const size_t cap); //Decodes the whole asset into dst. Returns decompressed size.
+    const ResourceCard* getResourceCard(const ResourceKey& key); //nullptr if not found. Loads the key's group first under BY_GROUP. Card may be rewritten if a later group redefines its key.
 
-    DataInputStreamer& openResource(const ResourceKey& key);
+    const bool ensureGroupLoaded(const uint32_t gid); //Blocks until group cards are in the map. No-op unless BY_GROUP.
+    void prefetchGroup(const uint32_t gid); //Starts parsing the group ASSH on a worker thread, returns immediately
+    const bool isGroupLoaded(const uint32_t gid);
 
     const uint64_t getMaxMemUsage() const { return max_mem;}
     const uint64_t getRecordedMemUsage() const { return mem_usage; }
@@ -160,7 +266,8 @@ public:
     const string& getSetting(const string& key);
     void setSetting(const string& key, const string& value);
 
-    const bool loadASSH(const string& path);
+    const bool loadASSH(const string& path); //Path is unix style, relative to root
+    const bool scanAllASSH(); //Loads every .assh under root. Where keys collide, the file with the later path wins.
     const bool loadConfigSettings(const UnicodeString& path);
     const bool saveConfigSettings(const string& path);
     const bool saveMainSettings(const string& path); //Returns false if manager is not mutable
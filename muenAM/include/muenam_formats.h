@@ -7,6 +7,17 @@
 #define INIBIN_HDR_FLAG_ASSHAES 0x0004
 #define INIBIN_HDR_FLAG_ALLAES 0x0008
 
+#define ASSH_MAGIC "assH"
+#define ASSH_ENTRY_FLAG_XOR 0x0001
+#define ASSH_ENTRY_COMP_MASK 0x0006
+#define ASSH_ENTRY_COMP_SHIFT 1
+#define ASSH_ENTRY_FLAG_CHUNKED 0x0008 //DEFLATE payload is split into independent chunks with an index at the front
+
+#define ASSH_COMP_NONE 0
+#define ASSH_COMP_DEFLATE 1
+#define ASSH_COMP_ZSTD 2 //Needs MUENAM_USE_ZSTD
+#define ASSH_COMP_LZ4 3 //LZ4 frame format. Needs MUENAM_USE_LZ4
+
 //C - structs for engine boot file formats
 
 #ifdef __cplusplus
@@ -57,6 +68,11 @@ typedef WRMUENAM_DLL_API struct muen_assh_entry {
 } muen_assh_entry_t;
 
 WRMUENAM_DLL_API void WRMUENAM_CDECL brev_muen_initbin_hdr(muen_initbin_hdr_t* hdr);
+WRMUENAM_DLL_API void WRMUENAM_CDECL brev_muen_assh_hdr(muen_assh_hdr_t* hdr);
+WRMUENAM_DLL_API void WRMUENAM_CDECL brev_muen_assh_entries(muen_assh_entry_t* entries, size_t count);
+
+//Writes the 16 byte TGI xor/key pattern (instance, group, type - each little-endian) to out
+WRMUENAM_DLL_API void WRMUENAM_CDECL muen_tgi_bytes(uint32_t type, uint32_t group, uint64_t instance, ubyte* out);
 
 #ifdef __cplusplus
 }
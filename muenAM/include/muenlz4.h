@@ -0,0 +1,124 @@
+#ifndef MUENLZ4_H_INCLUDED
+#define MUENLZ4_H_INCLUDED
+
+//LZ4 frame compression/decompression streams (ASSH compression code 3)
+//Only built if MUENAM_USE_LZ4 is defined. Link against liblz4.
+
+#ifdef MUENAM_USE_LZ4
+
+#include <string.h>
+
+#include "FileStreamer.h"
+#include "muenDefs.h"
+#include "muenzip.h"
+#include "lz4frame.h"
+
+#define MUENZIP_LZ4_LEVEL 0 //0 is LZ4 fast mode, 3+ is LZ4HC
+
+using namespace waffleoRai_Utils;
+
+namespace waffleoRai_muengine{
+
+class WRMUENAM_DLL_API MuenUnlz4Stream:public DataStreamerSource{
+
+private:
+    DataStreamerSource& input;
+    LZ4F_dctx* dctx;
+
+    size_t decomp_sz;
+    size_t output_ct;
+
+    const size_t buffer_sz;
+    ubyte* ibuffer;
+    ubyte* ibuff_p0;
+    ubyte* ibuff_p1;
+
+    ubyte* obuffer;
+    ubyte* obuff_p0;
+    ubyte* obuff_p1;
+
+    bool delsrc_on_close;
+    bool is_open;
+    bool z_end_flag;
+    size_t zerr;
+
+    void fillInputBuffer();
+    void decompNextBlock();
+
+public:
+    MuenUnlz4Stream(DataStreamerSource& src, const size_t buffer_size, const size_t decomp_size):input(src),dctx(nullptr),decomp_sz(decomp_size),output_ct(0),
+        buffer_sz(buffer_size),ibuffer(nullptr),ibuff_p0(nullptr),ibuff_p1(nullptr),obuffer(nullptr),obuff_p0(nullptr),obuff_p1(nullptr),
+        delsrc_on_close(false),is_open(false),z_end_flag(false),zerr(0){}
+
+    const int get() override;
+    const ubyte nextByte() override;
+    const size_t nextBytes(ubyte* dst, const size_t len) override;
+    const size_t peekSpan(const ubyte** span, const size_t len) override;
+    const size_t consume(const size_t len) override;
+	const bool remainingToEndKnown() const override{return true;}
+	const size_t remaining() const override;
+	const bool streamEnd() const override;
+
+	void open() override;
+	void close() override;
+	const bool isOpen() const override{return is_open;}
+
+	const bool deleteSourceOnClose() const{return delsrc_on_close;}
+	void setDeleteSourceOnClose(bool flag){delsrc_on_close = flag;}
+
+	const size_t getZError() const{return zerr;}
+
+	//One-shot decompression of a whole frame from memory straight into dst. True if exactly dstlen bytes came out.
+	static const bool decompressBuffer(const ubyte* src, const size_t srclen, ubyte* dst, const size_t dstlen);
+
+    virtual ~MuenUnlz4Stream(){close();}
+
+};
+
+class WRMUENAM_DLL_API MuenLz4Stream: public DataOutputTarget{
+
+private:
+    DataOutputTarget& output;
+    LZ4F_cctx* cctx;
+
+    const size_t buffer_sz;
+    ubyte* ibuffer;
+    ubyte* ibuff_p1;
+
+    ubyte* obuffer;
+    size_t obuff_sz;
+
+    int level;
+    bool deltrg_on_close;
+    bool is_open;
+    size_t zerr;
+
+    const bool compressSpan(const ubyte* data, const size_t datlen);
+
+public:
+
+    MuenLz4Stream(DataOutputTarget& trg, const size_t buffer_size):output(trg),cctx(nullptr),buffer_sz(buffer_size),ibuffer(nullptr),ibuff_p1(nullptr),
+        obuffer(nullptr),obuff_sz(0),level(MUENZIP_LZ4_LEVEL),deltrg_on_close(false),is_open(false),zerr(0){}
+
+    const bool addByte(ubyte b) override;
+	const bool addBytes(const ubyte* data, const size_t datlen) override;
+	const bool isOpen() const override{return is_open;}
+
+	void open() override;
+    void close() override;
+
+	const bool deleteTargetOnClose(){return deltrg_on_close;}
+	void setDeleteTargetOnClose(bool flag){deltrg_on_close = flag;}
+	void setLevel(int lvl){level = lvl;}
+
+	const size_t getZError() const{return zerr;}
+
+    virtual ~MuenLz4Stream(){close();}
+
+};
+
+}
+
+#endif //MUENAM_USE_LZ4
+
+#endif // MUENLZ4_H_INCLUDED
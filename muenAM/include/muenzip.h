@@ -3,22 +3,93 @@
 
 //For compression/decompression streams
 #include <string.h>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 
 #include "FileStreamer.h"
+#include "muenDefs.h"
 #include "zlib.h"
 
 #define MUENZIP_DEFLATE_LEVEL 7
 #define MUENZIP_NOCOPY_THRESH 1028
+#define MUENZIP_DEFO_CHUNK_SIZE 0x40000
+#define MUENZIP_MAX_WORKERS 8
+#define MUENZIP_POOL_MAX_IDLE 8
+#define MUENZIP_POOL_MAX_BUFFER 0x400000
 
 using namespace waffleoRai_Utils;
 
 namespace waffleoRai_muengine{
 
+//Inflate context plus stream buffer, kept alive between resources by a MuenInflatePool
+typedef struct MuenInflateContext{
+    z_stream zstr;
+    ubyte* buffer;
+    size_t buffer_sz;
+} MuenInflateContext;
+
+//Thread-safe pool of initialized inflate contexts. Released contexts are inflateReset and kept (up to max_idle)
+//  so opening lots of small compressed resources doesn't pay for inflateInit/inflateEnd and a buffer alloc each time.
+//  Buffers bigger than max_buffer are freed on release rather than kept idle.
+class WRMUENAM_DLL_API MuenInflatePool{
+
+private:
+    std::mutex lock;
+    std::vector<MuenInflateContext*> idle;
+    const size_t max_idle;
+    const size_t max_buffer;
+
+public:
+    MuenInflatePool(const size_t max_idle_contexts = MUENZIP_POOL_MAX_IDLE, const size_t max_buffer_size = MUENZIP_POOL_MAX_BUFFER):
+        max_idle(max_idle_contexts),max_buffer(max_buffer_size){}
+
+    MuenInflateContext* acquire(const size_t buffer_size);
+    void release(MuenInflateContext* ctx);
+    void clear();
+
+    ~MuenInflatePool(){clear();}
+
+};
+
+//Fixed set of threads for chunk inflate jobs. Threads start on the first submit and are kept until the pool is destroyed,
+//  so a chunked resource doesn't start a thread per chunk.
+class WRMUENAM_DLL_API MuenWorkerPool{
+
+private:
+    std::mutex lock;
+    std::condition_variable wake;
+    std::deque<std::packaged_task<bool()>> queue;
+    std::vector<std::thread> threads;
+    const int thread_count;
+    bool stopping;
+
+    void workerLoop();
+
+public:
+    MuenWorkerPool(const int workers = 0); //0 picks from the hardware thread count, up to MUENZIP_MAX_WORKERS
+
+    std::future<bool> submit(std::function<bool()> job);
+    const int getWorkerCount() const{return thread_count;}
+
+    ~MuenWorkerPool();
+
+};
+
 class WRMUENAM_DLL_API MuenUnzipStream:public DataStreamerSource{
 
 private:
     DataStreamerSource& input;
-    z_stream zstr;
+    z_stream zstr; //Only used if not pooled
+    z_stream* zs;
+
+    MuenInflatePool* pool;
+    MuenInflateContext* pctx;
 
     size_t decomp_sz;
     size_t output_ct;
@@ -41,11 +112,17 @@ private:
     void unzipNextBlock();
 
 public:
-    MuenUnzipStream(DataStreamerSource& src, const size_t buffer_size, const size_t decomp_size):input(src),decomp_sz(decomp_size),output_ct(0),
+    MuenUnzipStream(DataStreamerSource& src, const size_t buffer_size, const size_t decomp_size, MuenInflatePool* inflate_pool = nullptr):input(src),
+        zs(nullptr),pool(inflate_pool),pctx(nullptr),decomp_sz(decomp_size),output_ct(0),
         buffer_sz(buffer_size),ibuffer(nullptr),ibuff_p0(nullptr),ibuff_p1(nullptr),obuffer(nullptr),obuff_p0(nullptr),obuff_p1(nullptr),
         delsrc_on_close(false),is_open(false),z_end_flag(false),zerr(Z_OK),zstr(){}
 
+    const int get() override;
     const ubyte nextByte() override;
+    const size_t nextBytes(ubyte* dst, const size_t len) override;
+    const size_t peekSpan(const ubyte** span, const size_t len) override;
+    const size_t consume(const size_t len) override;
+	const bool remainingToEndKnown() const override{return true;}
 	const size_t remaining() const override;
 	const bool streamEnd() const override;
 
@@ -58,10 +135,89 @@ public:
 
 	const int getZError() const{return zerr;}
 
+	//One-shot inflate of a whole zlib stream from memory straight into dst (single inflate(Z_FINISH)). True if exactly dstlen bytes came out.
+	static const bool inflateBuffer(const ubyte* src, const size_t srclen, ubyte* dst, const size_t dstlen, MuenInflatePool* pool = nullptr);
+
     virtual ~MuenUnzipStream(){close();}
 
 };
 
+//Reads a chunked DEFLATE payload (see fspec_assh_assp.txt): independently compressed chunks are
+//  inflated on worker threads a few chunks ahead of the reader. Seekable if the source is.
+class WRMUENAM_DLL_API MuenParallelUnzipStream:public DataStreamerSource{
+
+private:
+    typedef struct ChunkJob{
+        std::vector<ubyte> comp;
+        std::vector<ubyte> data;
+        std::future<bool> done;
+    } ChunkJob;
+
+    DataStreamerSource& input;
+    streampos base_pos; //Source position of payload start
+
+    size_t decomp_sz;
+    size_t output_ct;
+
+    u32 chunk_sz;
+    std::vector<u64> chunk_offs; //Chunk count + 1, relative to payload start
+
+    const int lookahead;
+    std::vector<ChunkJob> jobs; //Ring, chunk i lives in jobs[i % lookahead]
+    size_t next_issue; //Next chunk to read from source and hand to a worker
+    size_t cur_chunk;
+    bool cur_loaded;
+    const ubyte* out_p0;
+    const ubyte* out_p1;
+
+    MuenInflatePool* pool;
+    MuenWorkerPool* wpool;
+    std::unique_ptr<MuenWorkerPool> own_wpool; //Only if no pool was passed in
+
+    bool delsrc_on_close;
+    bool is_open;
+    bool failed;
+
+    static const bool inflateChunk(ChunkJob* job, MuenInflatePool* pool);
+    const bool readIndex();
+    void issueChunks();
+    const bool loadChunk();
+    void drainJobs();
+
+public:
+    MuenParallelUnzipStream(DataStreamerSource& src, const size_t decomp_size, const int workers = 0, MuenInflatePool* inflate_pool = nullptr, MuenWorkerPool* worker_pool = nullptr);
+
+    const int get() override;
+    const ubyte nextByte() override;
+    const size_t nextBytes(ubyte* dst, const size_t len) override;
+    const size_t peekSpan(const ubyte** span, const size_t len) override;
+    const size_t consume(const size_t len) override;
+	const bool remainingToEndKnown() const override{return true;}
+	const size_t remaining() const override{return decomp_sz - output_ct;}
+	const bool streamEnd() const override{return output_ct >= decomp_sz || failed;}
+
+	const bool isSeekable() const override{return input.isSeekable();}
+	const streampos seek(const streampos pos) override;
+	const streampos tell() override{return static_cast<streampos>(output_ct);}
+
+	void open() override;
+	void close() override;
+	const bool isOpen() const override{return is_open;}
+
+	const bool deleteSourceOnClose() const{return delsrc_on_close;}
+	void setDeleteSourceOnClose(bool flag){delsrc_on_close = flag;}
+
+	const u32 getChunkSize() const{return chunk_sz;}
+	const size_t getChunkCount() const{return chunk_offs.empty() ? 0 : chunk_offs.size() - 1;}
+
+	//Inflate a whole chunked payload from memory, each chunk straight into its slot in dst, spread over worker threads.
+	//Without a worker pool, threads are started for this call only.
+	static const bool inflateBuffer(const ubyte* src, const size_t srclen, ubyte* dst, const size_t dstlen, const int workers = 0, MuenInflatePool* pool = nullptr, MuenWorkerPool* worker_pool = nullptr);
+
+    virtual ~MuenParallelUnzipStream(){close();}
+
+};
+
 class WRMUENAM_DLL_API MuenZipStream: public DataOutputTarget{
 
 private:
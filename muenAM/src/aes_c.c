@@ -1,6 +1,32 @@
 
 #include "aes_c.h"
 
+//Table setup runs once, whichever thread gets to it first. (muenDefs.h already brings in windows.h on Windows)
+#ifndef _WIN32
+#   include <pthread.h>
+#endif
+
+//Hardware kernel availability (compile side). Whether the CPU has them is checked at runtime.
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#   define AES_HAVE_AESNI 1
+#   include <emmintrin.h>
+#   include <wmmintrin.h>
+#   ifdef _MSC_VER
+#       include <intrin.h>
+#       define AES_TARGET_AESNI
+#   else
+#       include <cpuid.h>
+#       define AES_TARGET_AESNI __attribute__((target("aes,sse2")))
+#   endif
+#elif (defined(__aarch64__) || defined(_M_ARM64)) && (defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_AES))
+#   define AES_HAVE_ARMCE 1
+#   include <arm_neon.h>
+#   if defined(__linux__)
+#       include <sys/auxv.h>
+#       include <asm/hwcap.h>
+#   endif
+#endif
+
 const int32_t AES_TBL_LOG[256] = {
             0x00, 0xff, 0xc8, 0x08, 0x91, 0x10, 0xd0, 0x36,
             0x5a, 0x3e, 0xd8, 0x43, 0x99, 0x77, 0xfe, 0x18,
@@ -72,21 +98,330 @@ const int32_t AES_TBL_ANTILOG[256] = {
 const int32_t AES_SHIFT_ROWS_MAP[16] = { 0, 5, 10, 15, 4, 9, 14, 3, 8, 13, 2, 7, 12, 1, 6, 11 };
 
 boolean AES_TABLESINIT = 0;
+int32_t AES_RCON[256];
+int32_t AES_SBOX[256];
+int32_t AES_SBOXINV[256];
+
+uint32_t AES_TTBL_ENC[4][256];
+uint32_t AES_TTBL_DEC[4][256];
+ubyte AES_SBOX8[256];
+ubyte AES_SBOXINV8[256];
+
+#define AES_ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define AES_GETU32(p) (((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16) | ((uint32_t)(p)[2] << 8) | (uint32_t)(p)[3])
+#define AES_PUTU32(p, v) { (p)[0] = (ubyte)((v) >> 24); (p)[1] = (ubyte)((v) >> 16); (p)[2] = (ubyte)((v) >> 8); (p)[3] = (ubyte)(v); }
+
+typedef const int (*aes_block_fn)(aes_key128_t* key, ubyte* src, ubyte* dst);
+
+static int aes_kernel = AES_KERNEL_TTABLE;
+static boolean aes_kernel_set = 0; //If never set explicitly, table init picks the best supported kernel
+static aes_block_fn aes_kern_enc = rijndael_enc_ttbl;
+static aes_block_fn aes_kern_dec = rijndael_dec_ttbl;
+
+/*----- Hardware kernels -----*/
+
+#ifdef AES_HAVE_AESNI
+
+static boolean aes_cpu_has_aesni(){
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuid(regs, 1);
+    return (regs[2] >> 25) & 1;
+#else
+    unsigned int a, b, c, d;
+    if(!__get_cpuid(1, &a, &b, &c, &d)) return 0;
+    return (c >> 25) & 1;
+#endif
+}
 
-const int aes_init_common_tables(){
-    if(!AES_TABLESINIT){
-        int32_t i = 0;
-        for(i = 0; i < 256; i++){
-            AES_RCON[i] = aes_rcon(i);
-            AES_SBOX[i] = aes_sbox(i);
-            AES_SBOXINV[AES_SBOX[i]] = i;
+AES_TARGET_AESNI static __m128i aesni_expand_step(__m128i key, __m128i assist){
+    assist = _mm_shuffle_epi32(assist, 0xff);
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    return _mm_xor_si128(key, assist);
+}
+
+AES_TARGET_AESNI static void aesni_gen_key_schedule(aes_key128_t* key){
+    __m128i rk[AES_KEYSLOTS_128];
+    int i;
+    rk[0] = _mm_loadu_si128((const __m128i*)key->aes_key);
+    //aeskeygenassist needs an immediate rcon
+    rk[1] = aesni_expand_step(rk[0], _mm_aeskeygenassist_si128(rk[0], 0x01));
+    rk[2] = aesni_expand_step(rk[1], _mm_aeskeygenassist_si128(rk[1], 0x02));
+    rk[3] = aesni_expand_step(rk[2], _mm_aeskeygenassist_si128(rk[2], 0x04));
+    rk[4] = aesni_expand_step(rk[3], _mm_aeskeygenassist_si128(rk[3], 0x08));
+    rk[5] = aesni_expand_step(rk[4], _mm_aeskeygenassist_si128(rk[4], 0x10));
+    rk[6] = aesni_expand_step(rk[5], _mm_aeskeygenassist_si128(rk[5], 0x20));
+    rk[7] = aesni_expand_step(rk[6], _mm_aeskeygenassist_si128(rk[6], 0x40));
+    rk[8] = aesni_expand_step(rk[7], _mm_aeskeygenassist_si128(rk[7], 0x80));
+    rk[9] = aesni_expand_step(rk[8], _mm_aeskeygenassist_si128(rk[8], 0x1b));
+    rk[10] = aesni_expand_step(rk[9], _mm_aeskeygenassist_si128(rk[9], 0x36));
+
+    for(i = 0; i < AES_KEYSLOTS_128; i++){
+        _mm_storeu_si128((__m128i*)(key->key_sched + (i << 4)), rk[i]);
+        if(i == 0 || i == AES_KEYSLOTS_128 - 1) _mm_storeu_si128((__m128i*)(key->dec_sched + (i << 4)), rk[AES_KEYSLOTS_128 - 1 - i]);
+        else _mm_storeu_si128((__m128i*)(key->dec_sched + (i << 4)), _mm_aesimc_si128(rk[AES_KEYSLOTS_128 - 1 - i]));
+    }
+}
+
+AES_TARGET_AESNI static const int rijndael_enc_aesni(aes_key128_t* key, ubyte* src, ubyte* dst){
+    if(!key || !src || !dst) return 0;
+    if(!key->is_init) aes_gen_key_schedule_128(key);
+
+    const __m128i* rk = (const __m128i*)key->key_sched;
+    __m128i s = _mm_xor_si128(_mm_loadu_si128((const __m128i*)src), _mm_loadu_si128(rk));
+    int r;
+    for(r = 1; r <= AES_ROUNDS_128; r++) s = _mm_aesenc_si128(s, _mm_loadu_si128(rk + r));
+    s = _mm_aesenclast_si128(s, _mm_loadu_si128(rk + AES_KEYSLOTS_128 - 1));
+    _mm_storeu_si128((__m128i*)dst, s);
+    return AES_KEYBYTES_128;
+}
+
+AES_TARGET_AESNI static const int rijndael_dec_aesni(aes_key128_t* key, ubyte* src, ubyte* dst){
+    if(!key || !src || !dst) return 0;
+    if(!key->is_init) aes_gen_key_schedule_128(key);
+
+    const __m128i* rk = (const __m128i*)key->dec_sched;
+    __m128i s = _mm_xor_si128(_mm_loadu_si128((const __m128i*)src), _mm_loadu_si128(rk));
+    int r;
+    for(r = 1; r <= AES_ROUNDS_128; r++) s = _mm_aesdec_si128(s, _mm_loadu_si128(rk + r));
+    s = _mm_aesdeclast_si128(s, _mm_loadu_si128(rk + AES_KEYSLOTS_128 - 1));
+    _mm_storeu_si128((__m128i*)dst, s);
+    return AES_KEYBYTES_128;
+}
+
+#define AESNI_LANES 8
+
+AES_TARGET_AESNI static void aesni_dec_cbc(const aes_key128_t* key, const ubyte* src, ubyte* dst, size_t bcount, ubyte* iv){
+    //CBC decryption has no chain dependency (plaintext i needs only ciphertext i and i-1), so run 8 blocks through the rounds together.
+    __m128i rk[AES_KEYSLOTS_128];
+    __m128i c[AESNI_LANES];
+    __m128i b[AESNI_LANES];
+    __m128i prev = _mm_loadu_si128((const __m128i*)iv);
+    int r, l;
+    for(r = 0; r < AES_KEYSLOTS_128; r++) rk[r] = _mm_loadu_si128((const __m128i*)(key->dec_sched + (r << 4)));
+
+    while(bcount >= AESNI_LANES){
+        for(l = 0; l < AESNI_LANES; l++){
+            c[l] = _mm_loadu_si128((const __m128i*)src + l);
+            b[l] = _mm_xor_si128(c[l], rk[0]);
         }
-        AES_TABLESINIT = 1;
+        for(r = 1; r <= AES_ROUNDS_128; r++){
+            for(l = 0; l < AESNI_LANES; l++) b[l] = _mm_aesdec_si128(b[l], rk[r]);
+        }
+        for(l = 0; l < AESNI_LANES; l++) b[l] = _mm_aesdeclast_si128(b[l], rk[AES_KEYSLOTS_128 - 1]);
+
+        _mm_storeu_si128((__m128i*)dst, _mm_xor_si128(b[0], prev));
+        for(l = 1; l < AESNI_LANES; l++) _mm_storeu_si128((__m128i*)dst + l, _mm_xor_si128(b[l], c[l - 1]));
+        prev = c[AESNI_LANES - 1];
+
+        src += AESNI_LANES << 4;
+        dst += AESNI_LANES << 4;
+        bcount -= AESNI_LANES;
+    }
+
+    while(bcount > 0){
+        c[0] = _mm_loadu_si128((const __m128i*)src);
+        b[0] = _mm_xor_si128(c[0], rk[0]);
+        for(r = 1; r <= AES_ROUNDS_128; r++) b[0] = _mm_aesdec_si128(b[0], rk[r]);
+        b[0] = _mm_aesdeclast_si128(b[0], rk[AES_KEYSLOTS_128 - 1]);
+        _mm_storeu_si128((__m128i*)dst, _mm_xor_si128(b[0], prev));
+        prev = c[0];
+        src += 16;
+        dst += 16;
+        bcount--;
+    }
+
+    _mm_storeu_si128((__m128i*)iv, prev);
+}
+
+AES_TARGET_AESNI static void aesni_enc_cbc(const aes_key128_t* key, const ubyte* src, ubyte* dst, size_t bcount, ubyte* iv){
+    //CBC encryption is serial, but this at least keeps the schedule in registers
+    __m128i rk[AES_KEYSLOTS_128];
+    __m128i s = _mm_loadu_si128((const __m128i*)iv);
+    int r;
+    for(r = 0; r < AES_KEYSLOTS_128; r++) rk[r] = _mm_loadu_si128((const __m128i*)(key->key_sched + (r << 4)));
+
+    while(bcount > 0){
+        s = _mm_xor_si128(s, _mm_loadu_si128((const __m128i*)src));
+        s = _mm_xor_si128(s, rk[0]);
+        for(r = 1; r <= AES_ROUNDS_128; r++) s = _mm_aesenc_si128(s, rk[r]);
+        s = _mm_aesenclast_si128(s, rk[AES_KEYSLOTS_128 - 1]);
+        _mm_storeu_si128((__m128i*)dst, s);
+        src += 16;
+        dst += 16;
+        bcount--;
+    }
+
+    _mm_storeu_si128((__m128i*)iv, s);
+}
+
+#endif //AES_HAVE_AESNI
+
+#ifdef AES_HAVE_ARMCE
+
+static boolean aes_cpu_has_armce(){
+#if defined(__APPLE__)
+    return 1;
+#elif defined(__linux__) && defined(HWCAP_AES)
+    return (getauxval(AT_HWCAP) & HWCAP_AES) != 0;
+#elif defined(_WIN32)
+    return IsProcessorFeaturePresent(PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE) != 0;
+#else
+    return 0;
+#endif
+}
+
+//Note ARM AESE/AESD do AddRoundKey first, so rounds are offset by one from x86
+
+static const int rijndael_enc_armce(aes_key128_t* key, ubyte* src, ubyte* dst){
+    if(!key || !src || !dst) return 0;
+    if(!key->is_init) aes_gen_key_schedule_128(key);
+
+    const ubyte* rk = key->key_sched;
+    uint8x16_t s = vld1q_u8(src);
+    int r;
+    for(r = 0; r < AES_ROUNDS_128; r++) s = vaesmcq_u8(vaeseq_u8(s, vld1q_u8(rk + (r << 4))));
+    s = vaeseq_u8(s, vld1q_u8(rk + (AES_ROUNDS_128 << 4)));
+    s = veorq_u8(s, vld1q_u8(rk + ((AES_KEYSLOTS_128 - 1) << 4)));
+    vst1q_u8(dst, s);
+    return AES_KEYBYTES_128;
+}
+
+static const int rijndael_dec_armce(aes_key128_t* key, ubyte* src, ubyte* dst){
+    if(!key || !src || !dst) return 0;
+    if(!key->is_init) aes_gen_key_schedule_128(key);
+
+    const ubyte* rk = key->dec_sched;
+    uint8x16_t s = vld1q_u8(src);
+    int r;
+    for(r = 0; r < AES_ROUNDS_128; r++) s = vaesimcq_u8(vaesdq_u8(s, vld1q_u8(rk + (r << 4))));
+    s = vaesdq_u8(s, vld1q_u8(rk + (AES_ROUNDS_128 << 4)));
+    s = veorq_u8(s, vld1q_u8(rk + ((AES_KEYSLOTS_128 - 1) << 4)));
+    vst1q_u8(dst, s);
+    return AES_KEYBYTES_128;
+}
+
+#define ARMCE_LANES 4
+
+static void armce_dec_cbc(const aes_key128_t* key, const ubyte* src, ubyte* dst, size_t bcount, ubyte* iv){
+    uint8x16_t rk[AES_KEYSLOTS_128];
+    uint8x16_t c[ARMCE_LANES];
+    uint8x16_t b[ARMCE_LANES];
+    uint8x16_t prev = vld1q_u8(iv);
+    int r, l;
+    for(r = 0; r < AES_KEYSLOTS_128; r++) rk[r] = vld1q_u8(key->dec_sched + (r << 4));
+
+    while(bcount >= ARMCE_LANES){
+        for(l = 0; l < ARMCE_LANES; l++) b[l] = c[l] = vld1q_u8(src + (l << 4));
+        for(r = 0; r < AES_ROUNDS_128; r++){
+            for(l = 0; l < ARMCE_LANES; l++) b[l] = vaesimcq_u8(vaesdq_u8(b[l], rk[r]));
+        }
+        for(l = 0; l < ARMCE_LANES; l++) b[l] = veorq_u8(vaesdq_u8(b[l], rk[AES_ROUNDS_128]), rk[AES_KEYSLOTS_128 - 1]);
+
+        vst1q_u8(dst, veorq_u8(b[0], prev));
+        for(l = 1; l < ARMCE_LANES; l++) vst1q_u8(dst + (l << 4), veorq_u8(b[l], c[l - 1]));
+        prev = c[ARMCE_LANES - 1];
+
+        src += ARMCE_LANES << 4;
+        dst += ARMCE_LANES << 4;
+        bcount -= ARMCE_LANES;
+    }
+
+    while(bcount > 0){
+        b[0] = c[0] = vld1q_u8(src);
+        for(r = 0; r < AES_ROUNDS_128; r++) b[0] = vaesimcq_u8(vaesdq_u8(b[0], rk[r]));
+        b[0] = veorq_u8(vaesdq_u8(b[0], rk[AES_ROUNDS_128]), rk[AES_KEYSLOTS_128 - 1]);
+        vst1q_u8(dst, veorq_u8(b[0], prev));
+        prev = c[0];
+        src += 16;
+        dst += 16;
+        bcount--;
+    }
+
+    vst1q_u8(iv, prev);
+}
+
+#endif //AES_HAVE_ARMCE
+
+const boolean aes_kernel_supported(const int kernel){
+    switch(kernel){
+    case AES_KERNEL_REFERENCE:
+    case AES_KERNEL_TTABLE:
         return 1;
+#ifdef AES_HAVE_AESNI
+    case AES_KERNEL_AESNI:
+        return aes_cpu_has_aesni();
+#endif
+#ifdef AES_HAVE_ARMCE
+    case AES_KERNEL_ARMCE:
+        return aes_cpu_has_armce();
+#endif
     }
     return 0;
 }
 
+static void aes_build_common_tables(){
+    int32_t i = 0;
+    for(i = 0; i < 256; i++){
+        AES_RCON[i] = aes_rcon(i);
+        AES_SBOX[i] = aes_sbox(i);
+        AES_SBOXINV[AES_SBOX[i]] = i;
+    }
+
+    //T-tables. Each entry is one column of MixColumns (or InvMixColumns) applied to an sbox output, MSB first.
+    //  Tables 1-3 are the same column rotated, so a round is 16 lookups and xors.
+    uint32_t s, si, te, td;
+    for(i = 0; i < 256; i++){
+        s = (uint32_t)AES_SBOX[i];
+        si = (uint32_t)AES_SBOXINV[i];
+        AES_SBOX8[i] = (ubyte)s;
+        AES_SBOXINV8[i] = (ubyte)si;
+
+        te = ((uint32_t)aes_gmul(s, 2) << 24) | (s << 16) | (s << 8) | (uint32_t)aes_gmul(s, 3);
+        td = ((uint32_t)aes_gmul(si, 14) << 24) | ((uint32_t)aes_gmul(si, 9) << 16) | ((uint32_t)aes_gmul(si, 13) << 8) | (uint32_t)aes_gmul(si, 11);
+        AES_TTBL_ENC[0][i] = te;
+        AES_TTBL_ENC[1][i] = AES_ROR32(te, 8);
+        AES_TTBL_ENC[2][i] = AES_ROR32(te, 16);
+        AES_TTBL_ENC[3][i] = AES_ROR32(te, 24);
+        AES_TTBL_DEC[0][i] = td;
+        AES_TTBL_DEC[1][i] = AES_ROR32(td, 8);
+        AES_TTBL_DEC[2][i] = AES_ROR32(td, 16);
+        AES_TTBL_DEC[3][i] = AES_ROR32(td, 24);
+    }
+
+    //Pick the fastest kernel the CPU supports, unless the caller already chose
+    if(!aes_kernel_set){
+        if(aes_kernel_supported(AES_KERNEL_AESNI)) aes_set_kernel(AES_KERNEL_AESNI);
+        else if(aes_kernel_supported(AES_KERNEL_ARMCE)) aes_set_kernel(AES_KERNEL_ARMCE);
+        aes_kernel_set = 0;
+    }
+
+    AES_TABLESINIT = 1;
+}
+
+#ifdef _WIN32
+static INIT_ONCE aes_tables_once = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK aes_build_common_tables_once(PINIT_ONCE once, PVOID param, PVOID* ctx){
+    aes_build_common_tables();
+    return TRUE;
+}
+#else
+static pthread_once_t aes_tables_once = PTHREAD_ONCE_INIT;
+#endif
+
+const int aes_init_common_tables(){
+    //Safe to call from any thread. Returns once the tables (and the default kernel) are ready.
+#ifdef _WIN32
+    InitOnceExecuteOnce(&aes_tables_once, aes_build_common_tables_once, NULL, NULL);
+#else
+    pthread_once(&aes_tables_once, aes_build_common_tables);
+#endif
+    return AES_TABLESINIT;
+}
+
 const int32_t aes_rcon(int32_t in){
     if(in == 0) return 0;
 
@@ -122,6 +457,19 @@ void aes_gen_key_schedule_128(aes_key128_t* key){
     if(key->is_init) return;
     aes_init_common_tables();
 
+    int i,j,k,c;
+#ifdef AES_HAVE_AESNI
+    if(aes_kernel == AES_KERNEL_AESNI){
+        aesni_gen_key_schedule(key);
+        for(i = 0; i < AES_RKWORDS_128; i++){
+            key->enc_rk[i] = AES_GETU32(key->key_sched + (i << 2));
+            key->dec_rk[i] = AES_GETU32(key->dec_sched + (i << 2));
+        }
+        key->is_init = 1;
+        return;
+    }
+#endif
+
     const int bcount = AES_KEYSLOTS_128 * AES_KEYBYTES_128;
 
     //key_schedule = new byte[slots][kbytes];
@@ -129,7 +477,6 @@ void aes_gen_key_schedule_128(aes_key128_t* key){
     ubyte* buff =  (ubyte*)key->key_sched; //I'm gonna try and cheese it
 
     //Copy key for first set
-    int i,j,k,c;
     ubyte* buffptr = buff;
     int32_t row[AES_KEYBYTES_128];
     int32_t lastrow[AES_KEYBYTES_128];
@@ -182,7 +529,23 @@ void aes_gen_key_schedule_128(aes_key128_t* key){
         for(j = 0; j < AES_KEYBYTES_128; j++){
             //key_schedule[i+1][j] = (byte)row[j];
             *(buffptr++) = (ubyte)row[j];
-            lastrow[i] = row[j];
+            lastrow[j] = row[j];
+        }
+    }
+
+    //Word schedules for the T-table kernel.
+    //Decryption uses the equivalent inverse cipher: round keys in reverse, with InvMixColumns applied to the middle rounds.
+    uint32_t w;
+    for(i = 0; i < AES_RKWORDS_128; i++) key->enc_rk[i] = AES_GETU32(buff + (i << 2));
+    for(i = 0; i < AES_KEYSLOTS_128; i++){
+        for(j = 0; j < 4; j++){
+            w = key->enc_rk[((AES_KEYSLOTS_128 - 1 - i) << 2) + j];
+            if(i > 0 && i < AES_KEYSLOTS_128 - 1){
+                w = AES_TTBL_DEC[0][AES_SBOX8[w >> 24]] ^ AES_TTBL_DEC[1][AES_SBOX8[(w >> 16) & 0xff]] ^
+                    AES_TTBL_DEC[2][AES_SBOX8[(w >> 8) & 0xff]] ^ AES_TTBL_DEC[3][AES_SBOX8[w & 0xff]];
+            }
+            key->dec_rk[(i << 2) + j] = w;
+            AES_PUTU32(key->dec_sched + (((i << 2) + j) << 2), w);
         }
     }
     key->is_init = 1;
@@ -242,7 +605,123 @@ const int32_t aes_gmul(int32_t a, int32_t b){
     return s;
 }
 
+const int aes_set_kernel(const int kernel){
+    switch(kernel){
+    case AES_KERNEL_REFERENCE:
+        aes_kern_enc = rijndael_enc_ref;
+        aes_kern_dec = rijndael_dec_ref;
+        aes_kernel = kernel;
+        break;
+    case AES_KERNEL_TTABLE:
+        aes_kern_enc = rijndael_enc_ttbl;
+        aes_kern_dec = rijndael_dec_ttbl;
+        aes_kernel = kernel;
+        break;
+#ifdef AES_HAVE_AESNI
+    case AES_KERNEL_AESNI:
+        if(!aes_cpu_has_aesni()) break;
+        aes_kern_enc = rijndael_enc_aesni;
+        aes_kern_dec = rijndael_dec_aesni;
+        aes_kernel = kernel;
+        break;
+#endif
+#ifdef AES_HAVE_ARMCE
+    case AES_KERNEL_ARMCE:
+        if(!aes_cpu_has_armce()) break;
+        aes_kern_enc = rijndael_enc_armce;
+        aes_kern_dec = rijndael_dec_armce;
+        aes_kernel = kernel;
+        break;
+#endif
+    }
+    aes_kernel_set = 1;
+    return aes_kernel;
+}
+
+const int aes_get_kernel(){
+    return aes_kernel;
+}
+
 const int rijndael_enc(aes_key128_t* key, ubyte* src, ubyte* dst){
+    return aes_kern_enc(key, src, dst);
+}
+
+const int rijndael_dec(aes_key128_t* key, ubyte* src, ubyte* dst){
+    return aes_kern_dec(key, src, dst);
+}
+
+const int rijndael_enc_ttbl(aes_key128_t* key, ubyte* src, ubyte* dst){
+    if(!key || !src || !dst) return 0;
+    if(!key->is_init) aes_gen_key_schedule_128(key);
+
+    const uint32_t* rk = key->enc_rk;
+    uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+    int r;
+
+    s0 = AES_GETU32(src) ^ rk[0];
+    s1 = AES_GETU32(src + 4) ^ rk[1];
+    s2 = AES_GETU32(src + 8) ^ rk[2];
+    s3 = AES_GETU32(src + 12) ^ rk[3];
+
+    for(r = 0; r < AES_ROUNDS_128; r++){
+        rk += 4;
+        t0 = AES_TTBL_ENC[0][s0 >> 24] ^ AES_TTBL_ENC[1][(s1 >> 16) & 0xff] ^ AES_TTBL_ENC[2][(s2 >> 8) & 0xff] ^ AES_TTBL_ENC[3][s3 & 0xff] ^ rk[0];
+        t1 = AES_TTBL_ENC[0][s1 >> 24] ^ AES_TTBL_ENC[1][(s2 >> 16) & 0xff] ^ AES_TTBL_ENC[2][(s3 >> 8) & 0xff] ^ AES_TTBL_ENC[3][s0 & 0xff] ^ rk[1];
+        t2 = AES_TTBL_ENC[0][s2 >> 24] ^ AES_TTBL_ENC[1][(s3 >> 16) & 0xff] ^ AES_TTBL_ENC[2][(s0 >> 8) & 0xff] ^ AES_TTBL_ENC[3][s1 & 0xff] ^ rk[2];
+        t3 = AES_TTBL_ENC[0][s3 >> 24] ^ AES_TTBL_ENC[1][(s0 >> 16) & 0xff] ^ AES_TTBL_ENC[2][(s1 >> 8) & 0xff] ^ AES_TTBL_ENC[3][s2 & 0xff] ^ rk[3];
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+
+    //Final round (no MixColumns)
+    rk += 4;
+    t0 = ((uint32_t)AES_SBOX8[s0 >> 24] << 24) ^ ((uint32_t)AES_SBOX8[(s1 >> 16) & 0xff] << 16) ^ ((uint32_t)AES_SBOX8[(s2 >> 8) & 0xff] << 8) ^ (uint32_t)AES_SBOX8[s3 & 0xff] ^ rk[0];
+    t1 = ((uint32_t)AES_SBOX8[s1 >> 24] << 24) ^ ((uint32_t)AES_SBOX8[(s2 >> 16) & 0xff] << 16) ^ ((uint32_t)AES_SBOX8[(s3 >> 8) & 0xff] << 8) ^ (uint32_t)AES_SBOX8[s0 & 0xff] ^ rk[1];
+    t2 = ((uint32_t)AES_SBOX8[s2 >> 24] << 24) ^ ((uint32_t)AES_SBOX8[(s3 >> 16) & 0xff] << 16) ^ ((uint32_t)AES_SBOX8[(s0 >> 8) & 0xff] << 8) ^ (uint32_t)AES_SBOX8[s1 & 0xff] ^ rk[2];
+    t3 = ((uint32_t)AES_SBOX8[s3 >> 24] << 24) ^ ((uint32_t)AES_SBOX8[(s0 >> 16) & 0xff] << 16) ^ ((uint32_t)AES_SBOX8[(s1 >> 8) & 0xff] << 8) ^ (uint32_t)AES_SBOX8[s2 & 0xff] ^ rk[3];
+    AES_PUTU32(dst, t0);
+    AES_PUTU32(dst + 4, t1);
+    AES_PUTU32(dst + 8, t2);
+    AES_PUTU32(dst + 12, t3);
+
+    return AES_KEYBYTES_128;
+}
+
+const int rijndael_dec_ttbl(aes_key128_t* key, ubyte* src, ubyte* dst){
+    if(!key || !src || !dst) return 0;
+    if(!key->is_init) aes_gen_key_schedule_128(key);
+
+    const uint32_t* rk = key->dec_rk;
+    uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+    int r;
+
+    s0 = AES_GETU32(src) ^ rk[0];
+    s1 = AES_GETU32(src + 4) ^ rk[1];
+    s2 = AES_GETU32(src + 8) ^ rk[2];
+    s3 = AES_GETU32(src + 12) ^ rk[3];
+
+    for(r = 0; r < AES_ROUNDS_128; r++){
+        rk += 4;
+        t0 = AES_TTBL_DEC[0][s0 >> 24] ^ AES_TTBL_DEC[1][(s3 >> 16) & 0xff] ^ AES_TTBL_DEC[2][(s2 >> 8) & 0xff] ^ AES_TTBL_DEC[3][s1 & 0xff] ^ rk[0];
+        t1 = AES_TTBL_DEC[0][s1 >> 24] ^ AES_TTBL_DEC[1][(s0 >> 16) & 0xff] ^ AES_TTBL_DEC[2][(s3 >> 8) & 0xff] ^ AES_TTBL_DEC[3][s2 & 0xff] ^ rk[1];
+        t2 = AES_TTBL_DEC[0][s2 >> 24] ^ AES_TTBL_DEC[1][(s1 >> 16) & 0xff] ^ AES_TTBL_DEC[2][(s0 >> 8) & 0xff] ^ AES_TTBL_DEC[3][s3 & 0xff] ^ rk[2];
+        t3 = AES_TTBL_DEC[0][s3 >> 24] ^ AES_TTBL_DEC[1][(s2 >> 16) & 0xff] ^ AES_TTBL_DEC[2][(s1 >> 8) & 0xff] ^ AES_TTBL_DEC[3][s0 & 0xff] ^ rk[3];
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+
+    rk += 4;
+    t0 = ((uint32_t)AES_SBOXINV8[s0 >> 24] << 24) ^ ((uint32_t)AES_SBOXINV8[(s3 >> 16) & 0xff] << 16) ^ ((uint32_t)AES_SBOXINV8[(s2 >> 8) & 0xff] << 8) ^ (uint32_t)AES_SBOXINV8[s1 & 0xff] ^ rk[0];
+    t1 = ((uint32_t)AES_SBOXINV8[s1 >> 24] << 24) ^ ((uint32_t)AES_SBOXINV8[(s0 >> 16) & 0xff] << 16) ^ ((uint32_t)AES_SBOXINV8[(s3 >> 8) & 0xff] << 8) ^ (uint32_t)AES_SBOXINV8[s2 & 0xff] ^ rk[1];
+    t2 = ((uint32_t)AES_SBOXINV8[s2 >> 24] << 24) ^ ((uint32_t)AES_SBOXINV8[(s1 >> 16) & 0xff] << 16) ^ ((uint32_t)AES_SBOXINV8[(s0 >> 8) & 0xff] << 8) ^ (uint32_t)AES_SBOXINV8[s3 & 0xff] ^ rk[2];
+    t3 = ((uint32_t)AES_SBOXINV8[s3 >> 24] << 24) ^ ((uint32_t)AES_SBOXINV8[(s2 >> 16) & 0xff] << 16) ^ ((uint32_t)AES_SBOXINV8[(s1 >> 8) & 0xff] << 8) ^ (uint32_t)AES_SBOXINV8[s0 & 0xff] ^ rk[3];
+    AES_PUTU32(dst, t0);
+    AES_PUTU32(dst + 4, t1);
+    AES_PUTU32(dst + 8, t2);
+    AES_PUTU32(dst + 12, t3);
+
+    return AES_KEYBYTES_128;
+}
+
+const int rijndael_enc_ref(aes_key128_t* key, ubyte* src, ubyte* dst){
     if(!key || !src || !dst) return 0;
 
     if(!key->is_init) aes_gen_key_schedule_128(key);
@@ -284,6 +763,7 @@ const int rijndael_enc(aes_key128_t* key, ubyte* src, ubyte* dst){
         //temp = xorArr(temp, key_schedule[kidx++]);
         for(j = 0; j < 16; j++) temp8a[j] = (ubyte)temp32a[j];
         aesutil_xor128(temp8a, &key->key_sched[(kidx++) << 4], temp8b);
+        for(j = 0; j < 16; j++) temp32a[j] = (int32_t)temp8b[j];
     }
 
     //Final round
@@ -300,7 +780,7 @@ const int rijndael_enc(aes_key128_t* key, ubyte* src, ubyte* dst){
     return AES_KEYBYTES_128;
 }
 
-const int rijndael_dec(aes_key128_t* key, ubyte* src, ubyte* dst){
+const int rijndael_dec_ref(aes_key128_t* key, ubyte* src, ubyte* dst){
     if(!key || !src || !dst) return 0;
 
     if(!key->is_init) aes_gen_key_schedule_128(key);
@@ -329,17 +809,17 @@ const int rijndael_dec(aes_key128_t* key, ubyte* src, ubyte* dst){
         //temp = xorArr(temp, key_schedule[kidx--]);
         aesutil_xor128(temp8a, &key->key_sched[(kidx--) << 4], temp8b);
 
-        //Mix columns
+        //Mix columns (inv)
         for(j = 0; j < 4; j++){
             base = j << 2;
             for(k = 0; k < 4; k++){
-                a[k] = (int32_t)temp8a[base+k] & 0xFF;
+                a[k] = (int32_t)temp8b[base+k] & 0xFF;
             }
 
-            temp8b[base+0] = (ubyte)(gmul(a[0], 14) ^ gmul(a[3], 9) ^ gmul(a[2], 13) ^ gmul(a[1], 11));
-            temp8b[base+1] = (ubyte)(gmul(a[1], 14) ^ gmul(a[0], 9) ^ gmul(a[3], 13) ^ gmul(a[2], 11));
-            temp8b[base+2] = (ubyte)(gmul(a[2], 14) ^ gmul(a[1], 9) ^ gmul(a[0], 13) ^ gmul(a[3], 11));
-            temp8b[base+3] = (ubyte)(gmul(a[3], 14) ^ gmul(a[2], 9) ^ gmul(a[1], 13) ^ gmul(a[0], 11));
+            temp8a[base+0] = (ubyte)(aes_gmul(a[0], 14) ^ aes_gmul(a[3], 9) ^ aes_gmul(a[2], 13) ^ aes_gmul(a[1], 11));
+            temp8a[base+1] = (ubyte)(aes_gmul(a[1], 14) ^ aes_gmul(a[0], 9) ^ aes_gmul(a[3], 13) ^ aes_gmul(a[2], 11));
+            temp8a[base+2] = (ubyte)(aes_gmul(a[2], 14) ^ aes_gmul(a[1], 9) ^ aes_gmul(a[0], 13) ^ aes_gmul(a[3], 11));
+            temp8a[base+3] = (ubyte)(aes_gmul(a[3], 14) ^ aes_gmul(a[2], 9) ^ aes_gmul(a[1], 13) ^ aes_gmul(a[0], 11));
         }
 
     }
@@ -347,15 +827,15 @@ const int rijndael_dec(aes_key128_t* key, ubyte* src, ubyte* dst){
     //Final round
     //Shift rows (inv)
     //for(j = 0; j < 16; j++) temp2[SHIFT_ROWS_MAP[j]] = temp[j];
-    for(j = 0; j < 16; j++) temp8a[AES_SHIFT_ROWS_MAP[j]] = temp8b[j];
+    for(j = 0; j < 16; j++) temp8b[AES_SHIFT_ROWS_MAP[j]] = temp8a[j];
 
     //Sub bytes (inv)
     //for(int j = 0; j < 16; j++) temp[j] = sbox_inv[temp2[j]];
-    for(j = 0; j < 16; j++) temp8b[j] = AES_SBOXINV[temp8a[j]];
+    for(j = 0; j < 16; j++) temp8a[j] = AES_SBOXINV[temp8b[j]];
 
     //Add round key
    // temp = xorArr(temp, key_schedule[kidx]);
-    aesutil_xor128(temp8b, &key->key_sched[kidx << 4], dst);
+    aesutil_xor128(temp8a, &key->key_sched[kidx << 4], dst);
 
     return AES_KEYBYTES_128;
 }
@@ -381,6 +861,76 @@ const int aes_decblock_cbc128(ubyte* src, ubyte* dst, aes_state128_t* state){
     return 16;
 }
 
+const size_t aes_encblocks_cbc128(const ubyte* src, ubyte* dst, const size_t bcount, aes_state128_t* state){
+    if(!src || !dst || !state || !state->key || !state->vec) return 0;
+    if(!state->key->is_init) aes_gen_key_schedule_128(state->key);
+
+    ubyte iv[AES_KEYBYTES_128];
+    memcpy(iv, state->vec, AES_KEYBYTES_128);
+
+#ifdef AES_HAVE_AESNI
+    if(aes_kernel == AES_KERNEL_AESNI) aesni_enc_cbc(state->key, src, dst, bcount, iv);
+    else
+#endif
+    {
+        ubyte temp[AES_KEYBYTES_128];
+        size_t b;
+        int i;
+        for(b = 0; b < bcount; b++){
+            for(i = 0; i < AES_KEYBYTES_128; i++) temp[i] = src[i] ^ iv[i];
+            aes_kern_enc(state->key, temp, iv);
+            memcpy(dst, iv, AES_KEYBYTES_128);
+            src += AES_KEYBYTES_128;
+            dst += AES_KEYBYTES_128;
+        }
+    }
+
+    memcpy(state->ivbuff, iv, AES_KEYBYTES_128);
+    state->vec = state->ivbuff;
+    return bcount * AES_KEYBYTES_128;
+}
+
+const size_t aes_decblocks_cbc128(ubyte* src, ubyte* dst, const size_t bcount, aes_state128_t* state){
+    if(!src || !dst || !state || !state->key || !state->vec) return 0;
+    if(!state->key->is_init) aes_gen_key_schedule_128(state->key);
+
+    ubyte iv[AES_KEYBYTES_128];
+    memcpy(iv, state->vec, AES_KEYBYTES_128);
+
+    switch(aes_kernel){
+#ifdef AES_HAVE_AESNI
+    case AES_KERNEL_AESNI:
+        aesni_dec_cbc(state->key, src, dst, bcount, iv);
+        break;
+#endif
+#ifdef AES_HAVE_ARMCE
+    case AES_KERNEL_ARMCE:
+        armce_dec_cbc(state->key, src, dst, bcount, iv);
+        break;
+#endif
+    default:
+        {
+            //Save each ciphertext block before decrypting over it, in case src == dst
+            ubyte ct[AES_KEYBYTES_128];
+            ubyte pt[AES_KEYBYTES_128];
+            size_t b;
+            for(b = 0; b < bcount; b++){
+                memcpy(ct, src, AES_KEYBYTES_128);
+                aes_kern_dec(state->key, ct, pt);
+                aesutil_xor128(pt, iv, dst);
+                memcpy(iv, ct, AES_KEYBYTES_128);
+                src += AES_KEYBYTES_128;
+                dst += AES_KEYBYTES_128;
+            }
+        }
+        break;
+    }
+
+    memcpy(state->ivbuff, iv, AES_KEYBYTES_128);
+    state->vec = state->ivbuff;
+    return bcount * AES_KEYBYTES_128;
+}
+
 const size_t aes_enc_cbc128(ubyte* src, ubyte* dst, const size_t length, ubyte* key, ubyte* iv){
 
     if(length % AES_KEYBYTES_128 != 0) return 0;
@@ -392,7 +942,10 @@ const size_t aes_enc_cbc128(ubyte* src, ubyte* dst, const size_t length, ubyte*
     if(!iv) iv = zeros;
 
     aes_key128_t* aeskey = aes_gen_key_128(key);
-    aes_state128_t state = {aeskey, iv};
+    aes_state128_t state;
+    memset(&state, 0, sizeof(aes_state128_t));
+    state.key = aeskey;
+    state.vec = iv;
     while(bcount < length){
         aes_encblock_cbc128(src, dst, &state);
         src += AES_KEYBYTES_128;
@@ -414,13 +967,11 @@ const size_t aes_dec_cbc128(ubyte* src, ubyte* dst, const size_t length, ubyte*
     if(!iv) iv = zeros;
 
     aes_key128_t* aeskey = aes_gen_key_128(key);
-    aes_state128_t state = {aeskey, iv};
-    while(bcount < length){
-        aes_decblock_cbc128(src, dst, &state);
-        src += AES_KEYBYTES_128;
-        dst += AES_KEYBYTES_128;
-        bcount += AES_KEYBYTES_128;
-    }
+    aes_state128_t state;
+    memset(&state, 0, sizeof(aes_state128_t));
+    state.key = aeskey;
+    state.vec = iv;
+    bcount = aes_decblocks_cbc128(src, dst, length / AES_KEYBYTES_128, &state);
 
     free(aeskey);
     return bcount;
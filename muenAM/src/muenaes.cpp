@@ -2,103 +2,248 @@
 
 namespace waffleoRai_muengine{
 
-const bool MuenDecryptStream::nextBlock(){
-    //First, populate input by pulling from source
-    //(return false if < 16 remain!)
-    int i = 0;
-    for(i = 0; i < 16; i++){
-        if(input.streamEnd()) return false;
-        *(ibuff+i) = input.nextByte();
+const size_t MuenDecryptStream::decryptInto(ubyte* dst, const size_t maxlen){
+    //Read as many whole blocks as fit, then decrypt them all in one call
+    //(A trailing partial block can't be decrypted, so it is dropped)
+    size_t want = maxlen & ~(size_t)0xf;
+    if(plain_sz != SIZE_UNKNOWN){
+        if(pos_p1 >= plain_sz) src_dry = true;
+        else if(want > ((plain_sz - pos_p1 + 15) & ~(size_t)0xf)) want = (plain_sz - pos_p1 + 15) & ~(size_t)0xf;
     }
+    if(src_dry || want == 0) return 0;
 
-    //Then decrypt
-    aes_decblock_cbc128(ibuff, obuff, &aes_state);
+    size_t amt = input.nextBytes(dst, want);
+    if(amt < want) src_dry = true;
+    amt &= ~(size_t)0xf;
+    if(amt > 0) aes_decblocks_cbc128(dst, dst, amt >> 4, &aes_state);
 
-    //Update pointers and positions
-    opos = 0;
-    ubyte* t = ibuff;
-    ibuff = vec;
-    vec = t;
+    //Padding after the plaintext end is decrypted with its block but not handed out
+    if(plain_sz != SIZE_UNKNOWN && pos_p1 + amt >= plain_sz){
+        amt = plain_sz - pos_p1;
+        src_dry = true;
+    }
+    pos_p1 += amt;
+    return amt;
+}
 
-    return true;
+const bool MuenDecryptStream::fillWindow(){
+    win_p0 = window;
+    win_p1 = window + decryptInto(window, window_sz);
+    return win_p1 > win_p0;
+}
+
+const int MuenDecryptStream::get(){
+    if(win_p0 >= win_p1){
+        if(!fillWindow()) return -1;
+    }
+    return static_cast<int>(*win_p0++);
 }
 
 const ubyte MuenDecryptStream::nextByte(){
-    if(opos >= 16){
-        if(!nextBlock()) return 0;
+    if(win_p0 >= win_p1){
+        if(!fillWindow()) return 0;
+    }
+    return *win_p0++;
+}
+
+const size_t MuenDecryptStream::nextBytes(ubyte* dst, const size_t len){
+    //Drain the window first
+    size_t ct = (size_t)(win_p1 - win_p0);
+    if(ct > len) ct = len;
+    memcpy(dst, win_p0, ct);
+    win_p0 += ct;
+
+    //Whole blocks go straight into the caller's buffer
+    if(len - ct >= 16){
+        win_p0 = win_p1 = window;
+        ct += decryptInto(dst + ct, len - ct);
+    }
+
+    //Tail
+    while(ct < len){
+        if(!fillWindow()) break;
+        size_t amt = (size_t)(win_p1 - win_p0);
+        if(amt > len - ct) amt = len - ct;
+        memcpy(dst + ct, win_p0, amt);
+        win_p0 += amt;
+        ct += amt;
     }
+    return ct;
+}
 
-    return *(obuff + opos++);
+const size_t MuenDecryptStream::peekSpan(const ubyte** span, const size_t len){
+    if(win_p0 >= win_p1) fillWindow();
+    *span = win_p0;
+    const size_t avail = (size_t)(win_p1 - win_p0);
+    return len < avail ? len : avail;
+}
+
+const size_t MuenDecryptStream::consume(const size_t len){
+    size_t ct = 0;
+    while(ct < len){
+        if(win_p0 >= win_p1){
+            if(!fillWindow()) break;
+        }
+        size_t amt = (size_t)(win_p1 - win_p0);
+        if(amt > len - ct) amt = len - ct;
+        win_p0 += amt;
+        ct += amt;
+    }
+    return ct;
 }
 
 const size_t MuenDecryptStream::remaining() const{
-    return input.remaining() + (16-opos);
+    //Only whole blocks left in the source will ever come out
+    const size_t buffered = (size_t)(win_p1 - win_p0);
+    if(src_dry) return buffered;
+    if(plain_sz != SIZE_UNKNOWN){
+        const size_t pos = pos_p1 - buffered;
+        const size_t left = pos < plain_sz ? plain_sz - pos : 0;
+        if(!input.remainingToEndKnown()) return left;
+        const size_t srcleft = buffered + (input.remaining() & ~(size_t)0xf);
+        return srcleft < left ? srcleft : left;
+    }
+    if(!input.remainingToEndKnown()) return SIZE_UNKNOWN;
+    return buffered + (input.remaining() & ~(size_t)0xf);
 }
 
 const bool MuenDecryptStream::streamEnd() const{
-    return(remaining() <= 0);
+    if(win_p0 < win_p1) return false;
+    if(src_dry || pos_p1 >= plain_sz) return true;
+    if(input.remainingToEndKnown()) return input.remaining() < 16;
+    return input.streamEnd();
+}
+
+const streampos MuenDecryptStream::seek(const streampos pos){
+    if(!is_open || !input.isSeekable()) return SIZE_UNKNOWN;
+    if(pos < 0) throw InputException("waffleoRai_muengine::MuenDecryptStream::seek", "Seek position is invalid!");
+    const size_t trg = static_cast<size_t>(pos);
+
+    //Already in the window
+    const size_t win_pos = pos_p1 - (size_t)(win_p1 - window);
+    if(trg >= win_pos && trg <= pos_p1){
+        win_p0 = window + (trg - win_pos);
+        return pos;
+    }
+
+    //CBC: block k only needs ciphertext block k-1 as its IV, so read that instead of replaying from the start
+    const size_t blk = trg & ~(size_t)0xf;
+    src_dry = false;
+    if(blk == 0){
+        input.seek(base_pos);
+        aes_state.vec = init_vec;
+    }
+    else{
+        input.seek(base_pos + static_cast<std::streamoff>(blk - 16));
+        if(input.nextBytes(aes_state.ivbuff, 16) < 16) src_dry = true;
+        aes_state.vec = aes_state.ivbuff;
+    }
+    pos_p1 = blk;
+    win_p0 = win_p1 = window;
+
+    if(trg > blk){
+        fillWindow();
+        const size_t skip = trg - blk;
+        win_p0 += (skip < (size_t)(win_p1 - win_p0)) ? skip : (size_t)(win_p1 - win_p0);
+    }
+    return tell();
+}
+
+const streampos MuenDecryptStream::tell(){
+    if(!is_open) return SIZE_UNKNOWN;
+    return static_cast<streampos>(pos_p1 - (size_t)(win_p1 - win_p0));
 }
 
 void MuenDecryptStream::open(){
+    if(is_open) return;
     if(!input.isOpen()) input.open();
 
-    nextBlock();
+    window = (ubyte*)malloc(window_sz);
+    win_p0 = win_p1 = window;
+    pos_p1 = 0;
+    base_pos = input.isSeekable() ? input.tell() : static_cast<streampos>(0);
+    src_dry = false;
     is_open = true;
 }
 
 void MuenDecryptStream::close(){
     if(!is_open) return;
+    if(window) free(window);
+    window = win_p0 = win_p1 = nullptr;
     if(delsrc_on_close) delete &input;
-    //Shouldn't need to free anything else...
     is_open = false;
 }
 
-const bool MuenEncryptStream::flushOutput(){
-
-    aes_decblock_cbc128(ibuff, obuff, &aes_state);
-
-    output.addBytes(obuff, 16);
-    opos = 0;
-    ubyte* t = obuff;
-    obuff = vec;
-    vec = t;
-
+const bool MuenEncryptStream::encryptBlocks(const ubyte* src, const size_t bcount){
+    const size_t bmax = obuff_sz >> 4;
+    size_t ct = 0;
+    while(ct < bcount){
+        size_t amt = bcount - ct;
+        if(amt > bmax) amt = bmax;
+        aes_encblocks_cbc128(src + (ct << 4), obuffer, amt, &aes_state);
+        if(!output.addBytes(obuffer, amt << 4)) return false;
+        ct += amt;
+    }
     return true;
 }
 
 const bool MuenEncryptStream::addByte(ubyte b){
-
-    if(opos >= 16){
-       if (!flushOutput()) return false;
+    ibuff[ipos++] = b;
+    if(ipos >= 16){
+        ipos = 0;
+        return encryptBlocks(ibuff, 1);
     }
-    *(ibuff + opos++) = b;
     return true;
 }
 
 const bool MuenEncryptStream::addBytes(const ubyte* data, const size_t datlen){
-
-    //To be on the safe side with block alignment, this WILL copy bytes into buffer...
+    if(!data || datlen <= 0) return false;
     size_t ct = 0;
-    const ubyte* ptr = data;
-    for(ct = 0; ct < datlen; ct++){
-       if(!addByte(*ptr++)) return false;
+
+    //Top off a partial block from an earlier call
+    if(ipos > 0){
+        size_t amt = 16 - ipos;
+        if(amt > datlen) amt = datlen;
+        memcpy(ibuff + ipos, data, amt);
+        ipos += static_cast<int>(amt);
+        ct += amt;
+        if(ipos < 16) return true;
+        ipos = 0;
+        if(!encryptBlocks(ibuff, 1)) return false;
+    }
+
+    //Whole blocks are encrypted straight from the caller's buffer
+    const size_t whole = (datlen - ct) & ~(size_t)0xf;
+    if(whole > 0){
+        if(!encryptBlocks(data + ct, whole >> 4)) return false;
+        ct += whole;
     }
 
+    //Hold the tail
+    if(ct < datlen){
+        ipos = static_cast<int>(datlen - ct);
+        memcpy(ibuff, data + ct, ipos);
+    }
     return true;
 }
 
 void MuenEncryptStream::open(){
+    if(is_open) return;
     if(!output.isOpen()) output.open();
+    obuffer = (ubyte*)malloc(obuff_sz);
     is_open = true;
 }
 
 void MuenEncryptStream::close(){
     if(!is_open) return;
     //If there is an incomplete block, zero pad and encrypt before closing
-    if(opos > 0 && opos < 16){
-        while(opos < 16) addByte(0);
-        flushOutput();
+    if(ipos > 0){
+        memset(ibuff + ipos, 0, 16 - ipos);
+        ipos = 0;
+        encryptBlocks(ibuff, 1);
     }
+    if(obuffer) free(obuffer);
+    obuffer = nullptr;
 
     if(deltrg_on_close) delete &output;
     is_open = false;
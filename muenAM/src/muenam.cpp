@@ -1,25 +1,106 @@
 
 #include "muenam.h"
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MUEN_XOR_SSE2 1
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define MUEN_XOR_NEON 1
+#endif
+
+#define MUEN_XOR_CHUNK 0x1000
 
 namespace waffleoRai_muengine{
 
+static void xorSpan(ubyte* dst, const ubyte* src, const size_t len, const ubyte* xorkey, const int phase){
+    //Rotate the key so lane 0 lines up with the current key position, then XOR 16 bytes at a time
+    ubyte rkey[16];
+    for(int i = 0; i < 16; i++) rkey[i] = xorkey[(phase + i) & 0xf];
+
+    size_t i = 0;
+#if defined(MUEN_XOR_SSE2)
+    const __m128i k = _mm_loadu_si128((const __m128i*)rkey);
+    for(; i + 64 <= len; i += 64){
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(src + i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i*)(src + i + 48));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(a, k));
+        _mm_storeu_si128((__m128i*)(dst + i + 16), _mm_xor_si128(b, k));
+        _mm_storeu_si128((__m128i*)(dst + i + 32), _mm_xor_si128(c, k));
+        _mm_storeu_si128((__m128i*)(dst + i + 48), _mm_xor_si128(d, k));
+    }
+    for(; i + 16 <= len; i += 16){
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(_mm_loadu_si128((const __m128i*)(src + i)), k));
+    }
+#elif defined(MUEN_XOR_NEON)
+    const uint8x16_t k = vld1q_u8(rkey);
+    for(; i + 16 <= len; i += 16) vst1q_u8(dst + i, veorq_u8(vld1q_u8(src + i), k));
+#endif
+    for(; i < len; i++) dst[i] = src[i] ^ rkey[i & 0xf];
+}
+
 /*----- MuamDexorStream -----*/
 
+const int MuenDexorStream::get(){
+    const int b = input.get();
+    if(b < 0) return b;
+    if(pos >= 16) pos = 0;
+    return b ^ xorkey[pos++];
+}
+
 const ubyte MuenDexorStream::nextByte(){
     if(pos >= 16) pos = 0;
     return input.nextByte() ^ xorkey[pos++];
 }
 
+const size_t MuenDexorStream::nextBytes(ubyte* dst, const size_t len){
+    const size_t amt = input.nextBytes(dst, len);
+    xorSpan(dst, dst, amt, xorkey, pos & 0xf);
+    pos = static_cast<int>(((pos & 0xf) + amt) & 0xf);
+    return amt;
+}
+
+const size_t MuenDexorStream::consume(const size_t len){
+    const size_t amt = input.consume(len);
+    pos = static_cast<int>(((pos & 0xf) + amt) & 0xf);
+    return amt;
+}
+
 const size_t MuenDexorStream::remaining() const{
-    return input.remaining() + (16-pos);
+    //No buffering here, so the same as the source
+    return input.remaining();
 }
 
 const bool MuenDexorStream::streamEnd() const{
     return(remaining() <= 0);
 }
 
+const streampos MuenDexorStream::seek(const streampos pos){
+    //Key phase follows the position relative to where the stream was opened
+    if(pos < 0) throw InputException("waffleoRai_muengine::MuenDexorStream::seek", "Seek position is invalid!");
+    const streampos res = input.seek(base_pos + pos);
+    if(res == static_cast<streampos>(SIZE_UNKNOWN)) return res;
+    const size_t rel = static_cast<size_t>(res - base_pos);
+    this->pos = static_cast<int>(rel & 0xf);
+    return static_cast<streampos>(rel);
+}
+
+const streampos MuenDexorStream::tell(){
+    const streampos res = input.tell();
+    if(res == static_cast<streampos>(SIZE_UNKNOWN)) return res;
+    return res - base_pos;
+}
+
 void MuenDexorStream::open(){
+    if(is_open) return;
     if(!input.isOpen()) input.open();
+    base_pos = input.isSeekable() ? input.tell() : static_cast<streampos>(0);
+    pos = 0;
     is_open = true;
 }
 
@@ -39,9 +120,17 @@ const bool MuenXorStream::addByte(ubyte b){
 
 const bool MuenXorStream::addBytes(const ubyte* data, const size_t datlen){
     if(!data || datlen <= 0) return false;
-    size_t i = 0;
-    const ubyte* ptr = data;
-    for(i = 0; i < datlen; i++) addByte(*ptr++);
+    //Source data is const, so XOR through a stack chunk
+    ubyte chunk[MUEN_XOR_CHUNK];
+    size_t ct = 0;
+    while(ct < datlen){
+        size_t amt = datlen - ct;
+        if(amt > MUEN_XOR_CHUNK) amt = MUEN_XOR_CHUNK;
+        xorSpan(chunk, data + ct, amt, xorkey, pos & 0xf);
+        pos = static_cast<int>(((pos & 0xf) + amt) & 0xf);
+        if(!output.addBytes(chunk, amt)) return false;
+        ct += amt;
+    }
     return true;
 }
 
@@ -56,6 +145,25 @@ void MuenXorStream::close(){
     is_open = false;
 }
 
+/*----- ResourceStreamChain -----*/
+
+void ResourceStreamChain::reset(){
+    //Tear down from the reader end, since each stage references the one before it
+    reader.reset();
+    unzip.reset();
+    punzip.reset();
+#ifdef MUENAM_USE_ZSTD
+    unzstd.reset();
+#endif
+#ifdef MUENAM_USE_LZ4
+    unlz4.reset();
+#endif
+    dexor.reset();
+    decrypt.reset();
+    window.reset();
+    in_use = false;
+}
+
 /*----- ResourceHandle -----*/
 
 /*----- AssetManager -----*/
@@ -169,6 +277,449 @@ AssetManager::AssetManager(const UnicodeString& inibin_path, const bool readonly
     dis.close();
 }
 
+void AssetManager::setRootPath(const UnicodeString& path) {
+    string u8 = string();
+    path.toUTF8String(u8);
+    pathtbl.setBasePath(std::filesystem::u8path(u8));
+}
+
+const bool AssetManager::readASSH(DataStreamerSource& src, ResourceMap& target) {
+    static_assert(sizeof(muen_assh_entry_t) == 80, "ASSH entry struct must match 80 byte on-disk record");
+    const bool brev = wrcu_sys_big_endian();
+
+    muen_assh_hdr_t hdr;
+    if (src.nextBytes(reinterpret_cast<ubyte*>(&hdr), sizeof(muen_assh_hdr_t)) != sizeof(muen_assh_hdr_t)) return false;
+    if (memcmp(hdr.magic, ASSH_MAGIC, 4) != 0) return false;
+    if (brev) brev_muen_assh_hdr(&hdr);
+    if (hdr.assettbl_off < sizeof(muen_assh_hdr_t)) return false;
+
+    //Skip to asset table (name table is not used at runtime)
+    size_t skipamt = hdr.assettbl_off - sizeof(muen_assh_hdr_t);
+    if (src.consume(skipamt) != skipamt) return false;
+
+    uint32_t ecount = 0;
+    if (src.nextBytes(reinterpret_cast<ubyte*>(&ecount), 4) != 4) return false;
+    if (brev) wrcu_reverseBytes(reinterpret_cast<uint8_t*>(&ecount), 4);
+    if (ecount == 0) return true;
+
+    //Count comes straight from the file, so make sure the table fits in it before allocating
+    const uint64_t tblsize = static_cast<uint64_t>(ecount) * sizeof(muen_assh_entry_t);
+    if (hdr.assh_size < static_cast<uint64_t>(hdr.assettbl_off) + 4) return false;
+    if (tblsize > hdr.assh_size - hdr.assettbl_off - 4) return false;
+
+    //Whole table in one read
+    vector<muen_assh_entry_t> entries(ecount);
+    if (src.nextBytes(reinterpret_cast<ubyte*>(entries.data()), static_cast<size_t>(tblsize)) != tblsize) return false;
+    if (brev) brev_muen_assh_entries(entries.data(), ecount);
+
+    const size_t pcount = pathtbl.getSize();
+    target.beginBulkInsert(ecount);
+    for (const muen_assh_entry_t& e : entries) {
+        ResourceCard& card = target.bulkAppend(ResourceKey(e.type, e.group, e.instance));
+        if (e.path_idx < pcount) card.filepath = &pathtbl.getPathAtIndex(static_cast<int>(e.path_idx));
+        else card.isValid = false;
+        card.offset = e.offset;
+        card.rawSize = static_cast<size_t>(e.pkged_size);
+        card.decompSize = static_cast<size_t>(e.decomp_size);
+        card.misc_flags = e.flags;
+        card.compressed = (e.flags & ASSH_ENTRY_COMP_MASK) != 0;
+    }
+    target.endBulkInsert(true);
+
+    return true;
+}
+
+const bool AssetManager::readASSHFile(const path& fullpath, ResourceMap& target) {
+    //Key must already be generated if ASSH is encrypted (it isn't generated here so this can run on worker threads)
+    try {
+        FileInputStreamer fis = FileInputStreamer(fullpath);
+        fis.open();
+
+        bool res = false;
+        if (encrypt_assh) {
+            if (!active_key) return false;
+            ubyte iv[16];
+            memcpy(iv, "muEngine", 8);
+            memcpy(iv + 8, gamecode, 8);
+            MuenDecryptStream decstr = MuenDecryptStream(fis, active_key, iv);
+            decstr.open();
+            res = readASSH(decstr, target);
+            decstr.close();
+        }
+        else res = readASSH(fis, target);
+
+        fis.close();
+        return res;
+    }
+    catch (exception& ex) {
+        printf("%s\n", ex.what());
+        return false;
+    }
+}
+
+const bool AssetManager::loadASSH(const string& path) {
+    if (encrypt_assh && !active_key) active_key = aes_gen_key_128(aes_key);
+    return readASSHFile(pathtbl.getBasePath() / std::filesystem::u8path(path), res_map);
+}
+
+const bool AssetManager::scanAllASSH() {
+    if (encrypt_assh && !active_key) active_key = aes_gen_key_128(aes_key);
+
+    vector<path> files;
+    try {
+        for (const std::filesystem::directory_entry& de : std::filesystem::recursive_directory_iterator(pathtbl.getBasePath())) {
+            if (de.is_regular_file() && de.path().extension() == ".assh") files.push_back(de.path());
+        }
+    }
+    catch (exception& ex) {
+        printf("%s\n", ex.what());
+        return false;
+    }
+    if (files.empty()) return true;
+
+    //Directory iteration order is unspecified, so sort to make the merge order (and so the conflict winner) stable
+    std::sort(files.begin(), files.end());
+
+    //Each file parses into its own map, so workers share nothing but the file index counter
+    const size_t fcount = files.size();
+    vector<ResourceMap> maps(fcount);
+    vector<ubyte> okay(fcount, 0); //Not vector<bool> - workers write neighbouring elements concurrently
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        size_t i = 0;
+        while ((i = next.fetch_add(1)) < fcount) okay[i] = readASSHFile(files[i], maps[i]) ? 1 : 0;
+    };
+
+    size_t tcount = static_cast<size_t>(std::thread::hardware_concurrency());
+    if (tcount < 1) tcount = 1;
+    if (tcount > fcount) tcount = fcount;
+    vector<std::thread> threads;
+    threads.reserve(tcount - 1);
+    for (size_t t = 1; t < tcount; t++) threads.emplace_back(worker);
+    worker();
+    for (std::thread& t : threads) t.join();
+
+    //Merge in path order. Bulk insert lets the last appended card win on a key collision.
+    size_t total = 0;
+    for (const ResourceMap& m : maps) total += m.countCards();
+    res_map.beginBulkInsert(total);
+    for (const ResourceMap& m : maps) {
+        for (const ResourceCard* card : m.getCardView()) res_map.bulkAppend(*card);
+    }
+    res_map.endBulkInsert(true);
+
+    bool allokay = true;
+    for (size_t i = 0; i < fcount; i++) allokay = allokay && (okay[i] != 0);
+    return allokay;
+}
+
+AsshGroupLoad* AssetManager::startGroupLoad(const uint32_t gid, const std::launch policy) {
+    //Caller must hold group_lock
+    auto itr = group_loads.find(gid);
+    if (itr != group_loads.end()) return itr->second.get();
+
+    auto pitr = group_paths.find(gid);
+    if (pitr == group_paths.end() || pitr->second.empty()) return nullptr;
+
+    //Key schedule is shared read-only by parse threads, so make it here rather than on the worker
+    if (encrypt_assh && !active_key) active_key = aes_gen_key_128(aes_key);
+
+    AsshGroupLoad* gl = new AsshGroupLoad();
+    group_loads[gid] = std::unique_ptr<AsshGroupLoad>(gl);
+    const path fullpath = pathtbl.getBasePath() / std::filesystem::u8path(pitr->second);
+    gl->parsed = std::async(policy, [this, gl, fullpath]() { return readASSHFile(fullpath, gl->cards); }).share();
+
+    return gl;
+}
+
+const bool AssetManager::ensureGroupLoaded(const uint32_t gid) {
+    if (cloadmdl != BY_GROUP) return true;
+
+    std::unique_lock<std::mutex> lock(group_lock);
+    AsshGroupLoad* gl = startGroupLoad(gid, std::launch::deferred);
+    if (!gl) return false;
+    if (gl->merged) return gl->okay;
+
+    //Parse (or wait for prefetch to finish) without holding the lock
+    std::shared_future<bool> parsed = gl->parsed;
+    lock.unlock();
+    const bool okay = parsed.get();
+    lock.lock();
+
+    if (!gl->merged) {
+        std::unique_lock<std::shared_mutex> cardlock(card_lock);
+        res_map.beginBulkInsert(gl->cards.countCards());
+        for (const ResourceCard* card : gl->cards.getCardView()) res_map.bulkAppend(*card);
+        res_map.endBulkInsert(true);
+        gl->cards = ResourceMap(); //Release staging memory
+        gl->okay = okay;
+        gl->merged = true;
+    }
+    return gl->okay;
+}
+
+void AssetManager::prefetchGroup(const uint32_t gid) {
+    if (cloadmdl != BY_GROUP) return;
+    std::lock_guard<std::mutex> lock(group_lock);
+    startGroupLoad(gid, std::launch::async);
+}
+
+const bool AssetManager::isGroupLoaded(const uint32_t gid) {
+    if (cloadmdl != BY_GROUP) return true;
+    std::lock_guard<std::mutex> lock(group_lock);
+    auto itr = group_loads.find(gid);
+    return (itr != group_loads.end()) && itr->second->merged;
+}
+
+const ResourceCard* AssetManager::getResourceCard(const ResourceKey& key) {
+    ensureGroupLoaded(key.groupID);
+    std::shared_lock<std::shared_mutex> lock(card_lock);
+    return res_map.findCard(key);
+}
+
+const bool AssetManager::copyResourceCard(const ResourceKey& key, ResourceCard& dst) {
+    //Copy under the lock, so a merge of another group can't change the card while it's being used
+    ensureGroupLoaded(key.groupID);
+    std::shared_lock<std::shared_mutex> lock(card_lock);
+    const ResourceCard* card = res_map.findCard(key);
+    if (!card) return false;
+    dst = *card;
+    return true;
+}
+
+FileMapping& AssetManager::getPackageMapping(const path& assp_path) {
+    //Caller must hold stream_lock. One mapping per package, shared by every resource window into it.
+    auto itr = assp_maps.find(&assp_path);
+    if (itr != assp_maps.end()) return *(itr->second);
+    FileMapping* fmap = new FileMapping(assp_path);
+    assp_maps[&assp_path] = std::unique_ptr<FileMapping>(fmap);
+    fmap->open();
+    return *fmap;
+}
+
+static const bool compressionSupported(const int comp) {
+    switch (comp) {
+    case ASSH_COMP_NONE:
+    case ASSH_COMP_DEFLATE:
+#ifdef MUENAM_USE_ZSTD
+    case ASSH_COMP_ZSTD:
+#endif
+#ifdef MUENAM_USE_LZ4
+    case ASSH_COMP_LZ4:
+#endif
+        return true;
+    }
+    return false;
+}
+
+ResourceReader AssetManager::openResource(const ResourceKey& key) {
+    ResourceCard card;
+    if (!copyResourceCard(key, card) || !card.isValid || !card.filepath) {
+        ResourceKey badkey = key;
+        throw NoResourceCardException("waffleoRai_muengine::AssetManager::openResource", "No valid resource card for key!", badkey);
+    }
+    const int comp = (card.misc_flags & ASSH_ENTRY_COMP_MASK) >> ASSH_ENTRY_COMP_SHIFT;
+    if (!compressionSupported(comp)) throw InputException("waffleoRai_muengine::AssetManager::openResource", "Resource uses unsupported compression type!");
+
+    std::lock_guard<std::mutex> lock(stream_lock);
+    FileMapping& fmap = getPackageMapping(*card.filepath);
+
+    ResourceStreamChain* chain = nullptr;
+    for (std::unique_ptr<ResourceStreamChain>& c : stream_pool) {
+        if (!c->in_use) {
+            chain = c.get();
+            break;
+        }
+    }
+    if (!chain) {
+        chain = new ResourceStreamChain();
+        stream_pool.push_back(std::unique_ptr<ResourceStreamChain>(chain));
+    }
+    chain->in_use = true;
+
+    try {
+        //Uncompressed assets end at decompSize, not at the end of any encryption padding
+        size_t winsize = card.rawSize;
+        if (comp == ASSH_COMP_NONE && !encrypt_all && card.decompSize < winsize) winsize = card.decompSize;
+        chain->window.emplace(fmap);
+        chain->window->open(static_cast<streampos>(card.offset), winsize);
+        DataStreamerSource* src = &*(chain->window);
+
+        ubyte tgi[16];
+        muen_tgi_bytes(key.typeID, key.groupID, key.instanceID, tgi);
+
+        if (encrypt_all) {
+            //Asset key is master key xor TGI. Asset IV is the same as the ASSH's.
+            aesutil_xor128(aes_key, tgi, chain->key.aes_key);
+            chain->key.is_init = 0; //Pooled chain may hold a previous resource's schedule
+            aes_gen_key_schedule_128(&chain->key);
+            ubyte iv[16];
+            memcpy(iv, "muEngine", 8);
+            memcpy(iv + 8, gamecode, 8);
+            chain->decrypt.emplace(*src, &chain->key, iv);
+            if (comp == ASSH_COMP_NONE) chain->decrypt->setPlainSize(card.decompSize);
+            chain->decrypt->open();
+            src = &*(chain->decrypt);
+        }
+
+        if (card.misc_flags & ASSH_ENTRY_FLAG_XOR) {
+            chain->dexor.emplace(*src, tgi);
+            chain->dexor->open();
+            src = &*(chain->dexor);
+        }
+
+        if (comp != ASSH_COMP_NONE) {
+            //Don't reserve the full comp buffer for small assets
+            size_t bsize = comp_buff_size;
+            if (card.rawSize < bsize && card.decompSize < bsize) {
+                bsize = card.rawSize + card.decompSize;
+                if (bsize < 0x1000) bsize = 0x1000;
+                if (bsize > comp_buff_size) bsize = comp_buff_size;
+            }
+
+            switch (comp) {
+            case ASSH_COMP_DEFLATE:
+                if (card.misc_flags & ASSH_ENTRY_FLAG_CHUNKED) {
+                    chain->punzip.emplace(*src, card.decompSize, 0, &inflate_pool, &unzip_workers);
+                    chain->punzip->open();
+                    if (!chain->punzip->isOpen()) throw InputException("waffleoRai_muengine::AssetManager::openResource", "Bad chunk index for chunked DEFLATE resource!");
+                    src = &*(chain->punzip);
+                    break;
+                }
+                chain->unzip.emplace(*src, bsize, card.decompSize, &inflate_pool);
+                chain->unzip->open();
+                if (!chain->unzip->isOpen()) throw InputException("waffleoRai_muengine::AssetManager::openResource", "Failed to initialize inflate stream!");
+                src = &*(chain->unzip);
+                break;
+#ifdef MUENAM_USE_ZSTD
+            case ASSH_COMP_ZSTD:
+                chain->unzstd.emplace(*src, bsize, card.decompSize);
+                chain->unzstd->open();
+                if (!chain->unzstd->isOpen()) throw InputException("waffleoRai_muengine::AssetManager::openResource", "Failed to initialize zstd stream!");
+                src = &*(chain->unzstd);
+                break;
+#endif
+#ifdef MUENAM_USE_LZ4
+            case ASSH_COMP_LZ4:
+                chain->unlz4.emplace(*src, bsize, card.decompSize);
+                chain->unlz4->open();
+                if (!chain->unlz4->isOpen()) throw InputException("waffleoRai_muengine::AssetManager::openResource", "Failed to initialize LZ4 stream!");
+                src = &*(chain->unlz4);
+                break;
+#endif
+            }
+        }
+
+        chain->reader.emplace(*src, Endianness::little_endian);
+        return ResourceReader(this, &*(chain->reader));
+    }
+    catch (...) {
+        chain->reset();
+        throw;
+    }
+}
+
+const size_t AssetManager::loadResourceInto(const ResourceKey& key, void* dst, const size_t cap) {
+    //Whole-asset path: decode straight from the package mapping into dst, skipping the stream chain buffers
+    ResourceCard card;
+    if (!copyResourceCard(key, card) || !card.isValid || !card.filepath) {
+        ResourceKey badkey = key;
+        throw NoResourceCardException("waffleoRai_muengine::AssetManager::loadResourceInto", "No valid resource card for key!", badkey);
+    }
+    const int comp = (card.misc_flags & ASSH_ENTRY_COMP_MASK) >> ASSH_ENTRY_COMP_SHIFT;
+    if (!compressionSupported(comp)) throw InputException("waffleoRai_muengine::AssetManager::loadResourceInto", "Resource uses unsupported compression type!");
+    const size_t outsize = static_cast<size_t>(card.decompSize);
+    if (!dst || cap < outsize) throw InputException("waffleoRai_muengine::AssetManager::loadResourceInto", "Destination buffer is too small for resource!");
+
+    //Mappings are never dropped while the manager is alive, so the pointer stays good after the lock is released
+    const ubyte* raw = nullptr;
+    size_t rawsize = static_cast<size_t>(card.rawSize);
+    {
+        std::lock_guard<std::mutex> lock(stream_lock);
+        FileMapping& fmap = getPackageMapping(*card.filepath);
+        if (card.offset > fmap.getSize() || rawsize > fmap.getSize() - card.offset) throw InputException("waffleoRai_muengine::AssetManager::loadResourceInto", "Resource runs past end of package!");
+        raw = fmap.getData() + card.offset;
+    }
+
+    //Encryption and XOR have to be undone in a scratch copy
+    vector<ubyte> scratch;
+    if (encrypt_all || (card.misc_flags & ASSH_ENTRY_FLAG_XOR)) {
+        ubyte tgi[16];
+        muen_tgi_bytes(key.typeID, key.groupID, key.instanceID, tgi);
+        scratch.assign(raw, raw + rawsize);
+
+        if (encrypt_all) {
+            aes_key128_t akey;
+            memset(&akey, 0, sizeof(aes_key128_t));
+            aesutil_xor128(aes_key, tgi, akey.aes_key);
+            aes_gen_key_schedule_128(&akey);
+            ubyte iv[16];
+            memcpy(iv, "muEngine", 8);
+            memcpy(iv + 8, gamecode, 8);
+            aes_state128_t astate;
+            memset(&astate, 0, sizeof(aes_state128_t));
+            astate.key = &akey;
+            astate.vec = iv;
+            rawsize &= ~(size_t)0xf; //Same as MuenDecryptStream, a trailing partial block is dropped
+            aes_decblocks_cbc128(scratch.data(), scratch.data(), rawsize >> 4, &astate);
+        }
+        if (card.misc_flags & ASSH_ENTRY_FLAG_XOR) xorSpan(scratch.data(), scratch.data(), rawsize, tgi, 0);
+        raw = scratch.data();
+    }
+
+    ubyte* out = static_cast<ubyte*>(dst);
+    bool okay = false;
+    switch (comp) {
+    case ASSH_COMP_NONE:
+        okay = rawsize >= outsize;
+        if (okay) memcpy(out, raw, outsize);
+        break;
+    case ASSH_COMP_DEFLATE:
+        if (card.misc_flags & ASSH_ENTRY_FLAG_CHUNKED) okay = MuenParallelUnzipStream::inflateBuffer(raw, rawsize, out, outsize, 0, &inflate_pool, &unzip_workers);
+        else okay = MuenUnzipStream::inflateBuffer(raw, rawsize, out, outsize, &inflate_pool);
+        break;
+#ifdef MUENAM_USE_ZSTD
+    case ASSH_COMP_ZSTD:
+        okay = MuenUnzstdStream::decompressBuffer(raw, rawsize, out, outsize);
+        break;
+#endif
+#ifdef MUENAM_USE_LZ4
+    case ASSH_COMP_LZ4:
+        okay = MuenUnlz4Stream::decompressBuffer(raw, rawsize, out, outsize);
+        break;
+#endif
+    }
+    if (!okay) throw InputException("waffleoRai_muengine::AssetManager::loadResourceInto", "Resource data could not be decoded!");
+    return outsize;
+}
+
+void AssetManager::closeResource(DataInputStreamer& reader) {
+    std::lock_guard<std::mutex> lock(stream_lock);
+    for (std::unique_ptr<ResourceStreamChain>& c : stream_pool) {
+        if (c->in_use && c->reader && &*(c->reader) == &reader) {
+            c->reset();
+            return;
+        }
+    }
+}
+
+ResourceReader& ResourceReader::operator=(ResourceReader&& other) noexcept {
+    if (this != &other) {
+        close();
+        owner = other.owner;
+        reader = other.reader;
+        other.owner = nullptr;
+        other.reader = nullptr;
+    }
+    return *this;
+}
+
+void ResourceReader::close() {
+    if (owner && reader) owner->closeResource(*reader);
+    owner = nullptr;
+    reader = nullptr;
+}
+
 const bool AssetManager::loadConfigSettings(const UnicodeString& path) {
     //Just a text (ASCII) file...
     try {
@@ -2,11 +2,44 @@
 
 void brev_muen_initbin_hdr(muen_initbin_hdr_t* hdr) {
 	if (!hdr) return;
-	wrcu_reverseBytes(&hdr->inibin_ver, 4);
-	wrcu_reverseBytes(&hdr->gamever_maj, 2);
-	wrcu_reverseBytes(&hdr->gamever_min, 2);
-	wrcu_reverseBytes(&hdr->gamever_bld, 2);
-	wrcu_reverseBytes(&hdr->flags, 2);
-	wrcu_reverseBytes(&hdr->last_mod, 8);
-	wrcu_reverseBytes(&hdr->memlmt, 8);
-}
\ No newline at end of file
+	wrcu_reverseBytes32Array(&hdr->inibin_ver, 1);
+	wrcu_reverseBytes16Array(&hdr->gamever_maj, 1);
+	wrcu_reverseBytes16Array(&hdr->gamever_min, 1);
+	wrcu_reverseBytes16Array(&hdr->gamever_bld, 1);
+	wrcu_reverseBytes16Array(&hdr->flags, 1);
+	wrcu_reverseBytes64Array(&hdr->last_mod, 1);
+	wrcu_reverseBytes64Array(&hdr->memlmt, 1);
+}
+
+void brev_muen_assh_hdr(muen_assh_hdr_t* hdr) {
+	if (!hdr) return;
+	wrcu_reverseBytes32Array(&hdr->assh_ver, 1);
+	wrcu_reverseBytes64Array(&hdr->assh_size, 1);
+	wrcu_reverseBytes32Array(&hdr->nametbl_off, 1);
+	wrcu_reverseBytes32Array(&hdr->assettbl_off, 1);
+}
+
+void brev_muen_assh_entries(muen_assh_entry_t* entries, size_t count) {
+	if (!entries) return;
+	size_t i;
+	muen_assh_entry_t* e = entries;
+	for (i = 0; i < count; i++) {
+		wrcu_reverseBytes32Array(&e->type, 1);
+		wrcu_reverseBytes32Array(&e->group, 1);
+		wrcu_reverseBytes64Array(&e->instance, 1);
+		wrcu_reverseBytes16Array(&e->flags, 1);
+		wrcu_reverseBytes32Array(&e->path_idx, 1);
+		wrcu_reverseBytes64Array(&e->offset, 1);
+		wrcu_reverseBytes64Array(&e->pkged_size, 1);
+		wrcu_reverseBytes64Array(&e->decomp_size, 1);
+		e++;
+	}
+}
+
+void muen_tgi_bytes(uint32_t type, uint32_t group, uint64_t instance, ubyte* out) {
+	if (!out) return;
+	int i;
+	for (i = 0; i < 8; i++) out[i] = (ubyte)(instance >> (i << 3));
+	for (i = 0; i < 4; i++) out[8 + i] = (ubyte)(group >> (i << 3));
+	for (i = 0; i < 4; i++) out[12 + i] = (ubyte)(type >> (i << 3));
+}
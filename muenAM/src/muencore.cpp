@@ -5,6 +5,7 @@
 #define INITEN_ERR_NOIDMATCH 2
 #define INITEN_ERR_INIBIN_READ_FAIL 3
 #define INITEN_ERR_INICFG_READ_FAIL 4
+#define INITEN_ERR_ASSH_READ_FAIL 5
 
 namespace waffleoRai_muengine{
 
@@ -39,7 +40,19 @@ const int EngineCore::readConfigFile() {
 }
 
 const int EngineCore::loadASSH() {
-     //TODO
+    if(!active_manager) return INITEN_ERR_ASSH_READ_FAIL;
+
+    //Group ASSHs are loaded on demand.
+    switch(active_manager->getCardLoadingModel()){
+        case ALL_ON_BOOT:
+            if(!active_manager->loadASSH(FNAME_MASTERASSH)) return INITEN_ERR_ASSH_READ_FAIL;
+            break;
+        case SCAN_ALL_ASSH:
+            if(!active_manager->scanAllASSH()) return INITEN_ERR_ASSH_READ_FAIL;
+            break;
+        default: break;
+    }
+
     return INITEN_ERR_NONE;
 }
 
@@ -138,6 +151,8 @@ AssetManager& EngineCore::initializeEngine() {
     if (res == INITEN_ERR_INICFG_READ_FAIL) throw EngineInitFailedException("waffleoRai_muengine::EngineCore::initializeEngine", "Init config file could not be read!");
 
     //Load any initial asset pack headers (like if there is a master...)
+    res = loadASSH();
+    if (res == INITEN_ERR_ASSH_READ_FAIL) throw EngineInitFailedException("waffleoRai_muengine::EngineCore::initializeEngine", "Master asset header could not be read!");
 
     //Return manager
     if (!active_manager) throw EngineInitFailedException("waffleoRai_muengine::EngineCore::initializeEngine", "Unknown error: manager not established!");
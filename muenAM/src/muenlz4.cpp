@@ -0,0 +1,268 @@
+#include "muenlz4.h"
+
+#ifdef MUENAM_USE_LZ4
+
+using namespace waffleoRai_Utils;
+
+namespace waffleoRai_muengine{
+
+void MuenUnlz4Stream::fillInputBuffer(){
+    while(ibuff_p1 < obuffer && !input.streamEnd()){
+        const size_t amt = input.nextBytes(ibuff_p1, (size_t)(obuffer - ibuff_p1));
+        if(amt == 0) break;
+        ibuff_p1 += amt;
+    }
+}
+
+void MuenUnlz4Stream::decompNextBlock(){
+    if(ibuff_p0 == ibuff_p1){
+        ibuff_p0 = ibuff_p1 = ibuffer;
+        fillInputBuffer();
+    }
+
+    size_t isize = (size_t)(ibuff_p1 - ibuff_p0);
+    size_t osize = buffer_sz - (size_t)(obuffer - ibuffer);
+
+    const size_t result = LZ4F_decompress(dctx, obuffer, &osize, ibuff_p0, &isize, NULL);
+    if(LZ4F_isError(result)){
+        zerr = result;
+        return;
+    }
+    if(result == 0) z_end_flag = true; //Frame fully decoded and flushed
+    else if(isize == 0 && osize == 0) z_end_flag = true; //No progress: source ran dry before the frame ended
+
+    ibuff_p0 += isize;
+    obuff_p0 = obuffer;
+    obuff_p1 = obuff_p0 + osize;
+}
+
+const bool MuenUnlz4Stream::decompressBuffer(const ubyte* src, const size_t srclen, ubyte* dst, const size_t dstlen){
+    LZ4F_dctx* ctx = nullptr;
+    if(LZ4F_isError(LZ4F_createDecompressionContext(&ctx, LZ4F_VERSION))) return false;
+
+    size_t ipos = 0;
+    size_t opos = 0;
+    size_t result = 1;
+    while(result != 0 && ipos < srclen){
+        size_t isize = srclen - ipos;
+        size_t osize = dstlen - opos;
+        result = LZ4F_decompress(ctx, dst + opos, &osize, src + ipos, &isize, NULL);
+        if(LZ4F_isError(result)) break;
+        if(isize == 0 && osize == 0) break;
+        ipos += isize;
+        opos += osize;
+    }
+
+    LZ4F_freeDecompressionContext(ctx);
+    return !LZ4F_isError(result) && (opos == dstlen);
+}
+
+const int MuenUnlz4Stream::get(){
+    if(streamEnd()) return -1;
+    return (int)nextByte();
+}
+
+const ubyte MuenUnlz4Stream::nextByte(){
+    const ubyte* span = nullptr;
+    if(peekSpan(&span, 1) < 1) return 0;
+    obuff_p0++;
+    output_ct++;
+    return *span;
+}
+
+const size_t MuenUnlz4Stream::peekSpan(const ubyte** span, const size_t len){
+    //A call can eat input (eg. frame header) without producing output, so keep going until it does or stops
+    while(obuff_p0 >= obuff_p1 && !z_end_flag && output_ct < decomp_sz && !zerr) decompNextBlock();
+    *span = obuff_p0;
+
+    size_t avail = (size_t)(obuff_p1 - obuff_p0);
+    if(avail > decomp_sz - output_ct) avail = decomp_sz - output_ct;
+    return len < avail ? len : avail;
+}
+
+const size_t MuenUnlz4Stream::nextBytes(ubyte* dst, const size_t len){
+    size_t ct = 0;
+    const ubyte* span = nullptr;
+    while(ct < len){
+        const size_t amt = peekSpan(&span, len - ct);
+        if(amt == 0) break;
+        memcpy(dst + ct, span, amt);
+        obuff_p0 += amt;
+        output_ct += amt;
+        ct += amt;
+    }
+    return ct;
+}
+
+const size_t MuenUnlz4Stream::consume(const size_t len){
+    size_t ct = 0;
+    const ubyte* span = nullptr;
+    while(ct < len){
+        const size_t amt = peekSpan(&span, len - ct);
+        if(amt == 0) break;
+        obuff_p0 += amt;
+        output_ct += amt;
+        ct += amt;
+    }
+    return ct;
+}
+
+const size_t MuenUnlz4Stream::remaining() const{
+    return decomp_sz - output_ct;
+}
+
+const bool MuenUnlz4Stream::streamEnd() const{
+    if(decomp_sz - output_ct <= 0) return true;
+    if(obuff_p0 < obuff_p1) return false;
+    //The decoder may still be holding output after the source is drained, so only stop once it stalls
+    return z_end_flag || zerr;
+}
+
+void MuenUnlz4Stream::open(){
+    if(!input.isOpen()) input.open();
+
+    if(LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION))){
+        dctx = nullptr;
+        is_open = false;
+        return;
+    }
+
+    //Same split as MuenUnzipStream: 25% input, 75% output
+    ibuffer = (ubyte*)malloc(buffer_sz);
+    ibuff_p0 = ibuff_p1 = ibuffer;
+    obuffer = ibuffer + (buffer_sz >> 2);
+    obuff_p0 = obuff_p1 = obuffer;
+
+    fillInputBuffer();
+    is_open = true;
+}
+
+void MuenUnlz4Stream::close(){
+    if(!is_open) return;
+
+    LZ4F_freeDecompressionContext(dctx);
+    dctx = nullptr;
+
+    free(ibuffer);
+    ibuff_p0 = ibuff_p1 = ibuffer = nullptr;
+    obuff_p0 = obuff_p1 = obuffer = nullptr;
+
+    if(delsrc_on_close) delete &input;
+    is_open = false;
+}
+
+/*----- MuenLz4Stream -----*/
+
+const bool MuenLz4Stream::compressSpan(const ubyte* data, const size_t datlen){
+    //obuffer is sized for a full input buffer, so feed at most that much per update
+    size_t ct = 0;
+    while(ct < datlen){
+        size_t amt = datlen - ct;
+        if(amt > buffer_sz) amt = buffer_sz;
+        const size_t result = LZ4F_compressUpdate(cctx, obuffer, obuff_sz, data + ct, amt, NULL);
+        if(LZ4F_isError(result)){
+            zerr = result;
+            return false;
+        }
+        if(result > 0){
+            if(!output.addBytes(obuffer, result)) return false;
+        }
+        ct += amt;
+    }
+    return true;
+}
+
+const bool MuenLz4Stream::addByte(ubyte b){
+    *(ibuff_p1++) = b;
+    if(ibuff_p1 >= ibuffer + buffer_sz){
+        const bool res = compressSpan(ibuffer, buffer_sz);
+        ibuff_p1 = ibuffer;
+        return res;
+    }
+    return true;
+}
+
+const bool MuenLz4Stream::addBytes(const ubyte* data, const size_t datlen){
+    if(!data || datlen <= 0) return false;
+
+    //Large spans go straight to LZ4F (which keeps its own window), after anything already staged
+    if(datlen >= MUENZIP_NOCOPY_THRESH){
+        if(ibuff_p1 > ibuffer){
+            if(!compressSpan(ibuffer, (size_t)(ibuff_p1 - ibuffer))) return false;
+            ibuff_p1 = ibuffer;
+        }
+        return compressSpan(data, datlen);
+    }
+
+    size_t ct = 0;
+    while(ct < datlen){
+        size_t amt = (size_t)((ibuffer + buffer_sz) - ibuff_p1);
+        if(amt > datlen - ct) amt = datlen - ct;
+        memcpy(ibuff_p1, data + ct, amt);
+        ibuff_p1 += amt;
+        ct += amt;
+        if(ibuff_p1 >= ibuffer + buffer_sz){
+            if(!compressSpan(ibuffer, buffer_sz)) return false;
+            ibuff_p1 = ibuffer;
+        }
+    }
+    return true;
+}
+
+void MuenLz4Stream::open(){
+    if(!output.isOpen()) output.open();
+
+    if(LZ4F_isError(LZ4F_createCompressionContext(&cctx, LZ4F_VERSION))){
+        cctx = nullptr;
+        is_open = false;
+        return;
+    }
+
+    LZ4F_preferences_t prefs;
+    memset(&prefs, 0, sizeof(LZ4F_preferences_t));
+    prefs.compressionLevel = level;
+
+    ibuffer = (ubyte*)malloc(buffer_sz);
+    ibuff_p1 = ibuffer;
+    obuff_sz = LZ4F_compressBound(buffer_sz, &prefs);
+    if(obuff_sz < LZ4F_HEADER_SIZE_MAX) obuff_sz = LZ4F_HEADER_SIZE_MAX;
+    obuffer = (ubyte*)malloc(obuff_sz);
+
+    const size_t result = LZ4F_compressBegin(cctx, obuffer, obuff_sz, &prefs);
+    if(LZ4F_isError(result) || !output.addBytes(obuffer, result)){
+        if(LZ4F_isError(result)) zerr = result;
+        LZ4F_freeCompressionContext(cctx);
+        cctx = nullptr;
+        free(ibuffer);
+        free(obuffer);
+        ibuffer = ibuff_p1 = obuffer = nullptr;
+        is_open = false;
+        return;
+    }
+
+    is_open = true;
+}
+
+void MuenLz4Stream::close(){
+    if(!is_open) return;
+
+    //Compress whatever is staged and end the frame
+    if(ibuff_p1 > ibuffer) compressSpan(ibuffer, (size_t)(ibuff_p1 - ibuffer));
+    const size_t result = LZ4F_compressEnd(cctx, obuffer, obuff_sz, NULL);
+    if(LZ4F_isError(result)) zerr = result;
+    else if(result > 0) output.addBytes(obuffer, result);
+
+    LZ4F_freeCompressionContext(cctx);
+    cctx = nullptr;
+
+    free(ibuffer);
+    free(obuffer);
+    ibuffer = ibuff_p1 = obuffer = nullptr;
+
+    if(deltrg_on_close) delete &output;
+    is_open = false;
+}
+
+}
+
+#endif //MUENAM_USE_LZ4
@@ -1,13 +1,138 @@
 
 #include "muenzip.h"
+#include <thread>
+#include <atomic>
+#include <algorithm>
 
 using namespace waffleoRai_Utils;
 
 namespace waffleoRai_muengine{
 
+/*----- MuenInflatePool -----*/
+
+MuenInflateContext* MuenInflatePool::acquire(const size_t buffer_size){
+    MuenInflateContext* ctx = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        //Prefer an idle context whose buffer is already big enough
+        size_t pick = idle.size();
+        for(size_t i = 0; i < idle.size(); i++){
+            if(idle[i]->buffer_sz >= buffer_size){
+                pick = i;
+                break;
+            }
+        }
+        if(pick == idle.size() && !idle.empty()) pick = idle.size() - 1;
+        if(pick < idle.size()){
+            ctx = idle[pick];
+            idle.erase(idle.begin() + pick);
+        }
+    }
+
+    if(!ctx){
+        ctx = new MuenInflateContext();
+        memset(&ctx->zstr, 0, sizeof(z_stream));
+        ctx->buffer = nullptr;
+        ctx->buffer_sz = 0;
+        if(inflateInit(&ctx->zstr) != Z_OK){
+            delete ctx;
+            return nullptr;
+        }
+    }
+
+    if(ctx->buffer_sz < buffer_size){
+        free(ctx->buffer);
+        ctx->buffer = (ubyte*)malloc(buffer_size);
+        ctx->buffer_sz = buffer_size;
+    }
+    return ctx;
+}
+
+void MuenInflatePool::release(MuenInflateContext* ctx){
+    if(!ctx) return;
+    if(ctx->buffer_sz > max_buffer){
+        free(ctx->buffer);
+        ctx->buffer = nullptr;
+        ctx->buffer_sz = 0;
+    }
+
+    //Reset now so acquire() doesn't have to
+    if(inflateReset(&ctx->zstr) == Z_OK){
+        std::lock_guard<std::mutex> guard(lock);
+        if(idle.size() < max_idle){
+            idle.push_back(ctx);
+            return;
+        }
+    }
+    inflateEnd(&ctx->zstr);
+    free(ctx->buffer);
+    delete ctx;
+}
+
+void MuenInflatePool::clear(){
+    std::lock_guard<std::mutex> guard(lock);
+    for(MuenInflateContext* ctx : idle){
+        inflateEnd(&ctx->zstr);
+        free(ctx->buffer);
+        delete ctx;
+    }
+    idle.clear();
+}
+
+/*----- MuenWorkerPool -----*/
+
+static const int defaultWorkerCount(){
+    const int hw = static_cast<int>(std::thread::hardware_concurrency());
+    return std::max(2, std::min(hw, MUENZIP_MAX_WORKERS));
+}
+
+MuenWorkerPool::MuenWorkerPool(const int workers):thread_count(workers > 0 ? workers : defaultWorkerCount()),stopping(false){}
+
+void MuenWorkerPool::workerLoop(){
+    while(true){
+        std::packaged_task<bool()> task;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [this](){return stopping || !queue.empty();});
+            if(queue.empty()) return;
+            task = std::move(queue.front());
+            queue.pop_front();
+        }
+        task();
+    }
+}
+
+std::future<bool> MuenWorkerPool::submit(std::function<bool()> job){
+    std::packaged_task<bool()> task(std::move(job));
+    std::future<bool> res = task.get_future();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if(threads.empty()){
+            for(int i = 0; i < thread_count; i++) threads.push_back(std::thread(&MuenWorkerPool::workerLoop, this));
+        }
+        queue.push_back(std::move(task));
+    }
+    wake.notify_one();
+    return res;
+}
+
+MuenWorkerPool::~MuenWorkerPool(){
+    //Anything still queued is run before the threads exit, so no future is left hanging
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for(std::thread& t : threads) t.join();
+}
+
+/*----- MuenUnzipStream -----*/
+
 void MuenUnzipStream::fillInputBuffer(){
     while(ibuff_p1 < obuffer && !input.streamEnd()){
-        *(ibuff_p1++) = input.nextByte();
+        const size_t amt = input.nextBytes(ibuff_p1, (size_t)(obuffer - ibuff_p1));
+        if(amt == 0) break;
+        ibuff_p1 += amt;
     }
 }
 
@@ -20,23 +145,57 @@ void MuenUnzipStream::unzipNextBlock(){
         fillInputBuffer();
     }
 
-    zstr.next_in = (Bytef*)ibuff_p0;
-    zstr.avail_in = (uInt)(ibuff_p1 - ibuff_p0);
-    uLong ict = zstr.total_in;
-    uLong oct = zstr.total_out;
+    zs->next_in = (Bytef*)ibuff_p0;
+    zs->avail_in = (uInt)(ibuff_p1 - ibuff_p0);
+    zs->next_out = (Bytef*)obuffer;
+    zs->avail_out = (uInt)(buffer_sz - (size_t)(obuffer - ibuffer));
+    uLong ict = zs->total_in;
+    uLong oct = zs->total_out;
 
     //Unzip
-    int result = inflate(&zstr, Z_SYNC_FLUSH);
+    int result = inflate(zs, Z_SYNC_FLUSH);
     if(result == Z_STREAM_END) z_end_flag = true;
-    else if(result != Z_OK){
-        zerr = result;
-        return;
-    }
+    else if(result != Z_OK) zerr = result;
 
     //Update positions
-    ibuff_p0 += (zstr.total_in - ict);
+    //Output from a call that then hit an error (eg. trailing cipher padding) is still good
+    ibuff_p0 += (zs->total_in - ict);
     obuff_p0 = obuffer;
-    obuff_p1 = obuff_p0 + (zstr.total_out - oct);
+    obuff_p1 = obuff_p0 + (zs->total_out - oct);
+}
+
+const bool MuenUnzipStream::inflateBuffer(const ubyte* src, const size_t srclen, ubyte* dst, const size_t dstlen, MuenInflatePool* pool){
+    z_stream local;
+    z_stream* zs = &local;
+    MuenInflateContext* ctx = nullptr;
+    if(pool){
+        ctx = pool->acquire(0);
+        if(!ctx) return false;
+        zs = &ctx->zstr;
+    }
+    else{
+        memset(&local, 0, sizeof(z_stream));
+        if(inflateInit(&local) != Z_OK) return false;
+    }
+
+    zs->next_in = (Bytef*)src;
+    zs->avail_in = (uInt)srclen;
+    zs->next_out = (Bytef*)dst;
+    zs->avail_out = (uInt)dstlen;
+    const int res = inflate(zs, Z_FINISH);
+
+    //MuenZipStream only sync flushes, so a stream with no end marker is fine as long as all of it came out.
+    //Like the streaming path, anything after decompSize bytes (eg. cipher block padding) is ignored.
+    const bool okay = (zs->total_out == dstlen) && (res == Z_STREAM_END || res == Z_BUF_ERROR || res == Z_OK || res == Z_DATA_ERROR);
+
+    if(ctx) pool->release(ctx);
+    else inflateEnd(&local);
+    return okay;
+}
+
+const int MuenUnzipStream::get(){
+    if(streamEnd()) return -1;
+    return (int)nextByte();
 }
 
 const ubyte MuenUnzipStream::nextByte(){
@@ -54,6 +213,43 @@ const ubyte MuenUnzipStream::nextByte(){
     return *(obuff_p0++);
 }
 
+const size_t MuenUnzipStream::peekSpan(const ubyte** span, const size_t len){
+    //Lend out whatever is sitting in the output buffer, inflating the next block if it's dry
+    if(obuff_p0 >= obuff_p1 && !z_end_flag && output_ct < decomp_sz && !zerr) unzipNextBlock();
+    *span = obuff_p0;
+
+    size_t avail = (size_t)(obuff_p1 - obuff_p0);
+    if(avail > decomp_sz - output_ct) avail = decomp_sz - output_ct;
+    return len < avail ? len : avail;
+}
+
+const size_t MuenUnzipStream::nextBytes(ubyte* dst, const size_t len){
+    size_t ct = 0;
+    const ubyte* span = nullptr;
+    while(ct < len){
+        const size_t amt = peekSpan(&span, len - ct);
+        if(amt == 0) break;
+        memcpy(dst + ct, span, amt);
+        obuff_p0 += amt;
+        output_ct += amt;
+        ct += amt;
+    }
+    return ct;
+}
+
+const size_t MuenUnzipStream::consume(const size_t len){
+    size_t ct = 0;
+    const ubyte* span = nullptr;
+    while(ct < len){
+        const size_t amt = peekSpan(&span, len - ct);
+        if(amt == 0) break;
+        obuff_p0 += amt;
+        output_ct += amt;
+        ct += amt;
+    }
+    return ct;
+}
+
 const u64 MuenUnzipStream::remaining() const{
     return decomp_sz - output_ct;
 }
@@ -71,36 +267,51 @@ const bool MuenUnzipStream::streamEnd() const{
 void MuenUnzipStream::open(){
     if(!input.isOpen()) input.open();
 
-    //Clear the zstr
-    memset(&zstr, 0, sizeof(z_stream));
+    if(pool){
+        //Pooled context is already initialized (or reset) and has a buffer at least buffer_sz big
+        pctx = pool->acquire(buffer_sz);
+        if(!pctx){
+            zerr = Z_MEM_ERROR;
+            is_open = false;
+            return;
+        }
+        zs = &pctx->zstr;
+        ibuffer = pctx->buffer;
+    }
+    else{
+        zs = &zstr;
+
+        //Clear the zstr
+        memset(&zstr, 0, sizeof(z_stream));
+
+        //This is redundant given the memset, but writing here for formality and later modification.
+        zstr.zalloc = Z_NULL; //Might update these if needed for thread-safety later on
+        zstr.zfree = Z_NULL;
+        zstr.opaque = Z_NULL;
+
+        //Init zstr!
+        int result = inflateInit(&zstr);
+        if(result != Z_OK){
+            zerr = result;
+            is_open = false;
+            return;
+        }
+
+        ibuffer = (ubyte*)malloc(buffer_sz);
+    }
 
-    //Allocate buffers
     //Gives 25% of requested buffer space to input and 75% to output
-    ibuffer = (ubyte*)malloc(buffer_sz);
     ibuff_p0 = ibuff_p1 = ibuffer;
     obuffer = ibuffer + (buffer_sz >> 2);
     obuff_p0 = obuff_p1 = obuffer;
+    output_ct = 0;
+    z_end_flag = false;
 
     //Set applicable zstr fields
-    zstr.next_in = (Bytef*)ibuffer;
-    zstr.next_out = (Bytef*)obuffer;
-    zstr.avail_in = (uInt)(obuffer - ibuffer);
-    zstr.avail_out = (uInt)buffer_sz - zstr.avail_in;
-
-    //This is redundant given the memset, but writing here for formality and later modification.
-    zstr.zalloc = Z_NULL; //Might update these if needed for thread-safety later on
-    zstr.zfree = Z_NULL;
-    zstr.opaque = Z_NULL;
-
-    //Init zstr!
-    int result = inflateInit(&zstr);
-
-    if(result != Z_OK){
-        //Clear out buffers and return
-        zerr = result;
-        is_open = false;
-        free(ibuffer);
-    }
+    zs->next_in = (Bytef*)ibuffer;
+    zs->next_out = (Bytef*)obuffer;
+    zs->avail_in = (uInt)(obuffer - ibuffer);
+    zs->avail_out = (uInt)buffer_sz - zs->avail_in;
 
     fillInputBuffer();
     is_open = true;
@@ -109,12 +320,20 @@ void MuenUnzipStream::open(){
 void MuenUnzipStream::close(){
     if(!is_open) return;
 
-    //Close the zstr
-    int result = inflateEnd(&zstr);
-    if(result != Z_OK) zerr = result;
+    if(pctx){
+        //Hand the context and buffer back instead of tearing them down
+        pool->release(pctx);
+        pctx = nullptr;
+    }
+    else{
+        //Close the zstr
+        int result = inflateEnd(&zstr);
+        if(result != Z_OK) zerr = result;
 
-    //Free internal buffers
-    free(ibuffer);
+        //Free internal buffers
+        free(ibuffer);
+    }
+    zs = nullptr;
     ibuff_p0 = ibuff_p1 = ibuffer = nullptr;
     obuff_p0 = obuff_p1 = obuffer = nullptr;
 
@@ -125,6 +344,282 @@ void MuenUnzipStream::close(){
     is_open = false;
 }
 
+/*----- MuenParallelUnzipStream -----*/
+
+static const u64 readLE(const ubyte* p, const int bytes){
+    u64 val = 0;
+    for(int i = bytes - 1; i >= 0; i--) val = (val << 8) | p[i];
+    return val;
+}
+
+MuenParallelUnzipStream::MuenParallelUnzipStream(DataStreamerSource& src, const size_t decomp_size, const int workers, MuenInflatePool* inflate_pool, MuenWorkerPool* worker_pool):input(src),base_pos(0),
+    decomp_sz(decomp_size),output_ct(0),chunk_sz(0),lookahead(workers > 0 ? workers : (worker_pool ? worker_pool->getWorkerCount() : defaultWorkerCount())),next_issue(0),cur_chunk(0),
+    cur_loaded(false),out_p0(nullptr),out_p1(nullptr),pool(inflate_pool),wpool(worker_pool),delsrc_on_close(false),is_open(false),failed(false){}
+
+const bool MuenParallelUnzipStream::inflateChunk(ChunkJob* job, MuenInflatePool* pool){
+    //Runs on a worker. Each chunk is its own zlib stream of known inflated size.
+    if(!pool){
+        uLongf dlen = (uLongf)job->data.size();
+        const int res = uncompress((Bytef*)job->data.data(), &dlen, (const Bytef*)job->comp.data(), (uLong)job->comp.size());
+        return (res == Z_OK) && (dlen == job->data.size());
+    }
+
+    MuenInflateContext* ctx = pool->acquire(0);
+    if(!ctx) return false;
+    z_stream* zs = &ctx->zstr;
+    zs->next_in = (Bytef*)job->comp.data();
+    zs->avail_in = (uInt)job->comp.size();
+    zs->next_out = (Bytef*)job->data.data();
+    zs->avail_out = (uInt)job->data.size();
+    const int res = inflate(zs, Z_FINISH);
+    const bool okay = (res == Z_STREAM_END) && (zs->total_out == job->data.size());
+    pool->release(ctx);
+    return okay;
+}
+
+const bool MuenParallelUnzipStream::readIndex(){
+    ubyte hdr[8];
+    if(input.nextBytes(hdr, 8) < 8) return false;
+    chunk_sz = static_cast<u32>(readLE(hdr, 4));
+    const size_t ccount = static_cast<size_t>(readLE(hdr + 4, 4));
+    if(chunk_sz == 0) return false;
+    if(ccount != (decomp_sz + chunk_sz - 1) / chunk_sz) return false;
+
+    const size_t isize = (ccount + 1) << 3;
+    std::vector<ubyte> raw(isize);
+    if(input.nextBytes(raw.data(), isize) < isize) return false;
+    chunk_offs.resize(ccount + 1);
+    for(size_t i = 0; i <= ccount; i++){
+        chunk_offs[i] = readLE(raw.data() + (i << 3), 8);
+        if(i > 0 && chunk_offs[i] < chunk_offs[i-1]) return false;
+    }
+
+    //Chunks are read sequentially from here on, so skip to the first one
+    const u64 hsize = 8 + isize;
+    if(chunk_offs[0] < hsize) return false;
+    if(chunk_offs[0] > hsize){
+        const size_t gap = static_cast<size_t>(chunk_offs[0] - hsize);
+        if(input.consume(gap) != gap) return false;
+    }
+    return true;
+}
+
+const bool MuenParallelUnzipStream::inflateBuffer(const ubyte* src, const size_t srclen, ubyte* dst, const size_t dstlen, const int workers, MuenInflatePool* pool, MuenWorkerPool* worker_pool){
+    if(srclen < 8) return false;
+    const u32 csize = static_cast<u32>(readLE(src, 4));
+    const size_t ccount = static_cast<size_t>(readLE(src + 4, 4));
+    if(csize == 0 || ccount != (dstlen + csize - 1) / csize) return false;
+    if(srclen < 8 + ((ccount + 1) << 3)) return false;
+
+    const ubyte* idx = src + 8;
+    for(size_t i = 0; i <= ccount; i++){
+        const u64 off = readLE(idx + (i << 3), 8);
+        if(off > srclen || (i > 0 && off < readLE(idx + ((i-1) << 3), 8))) return false;
+    }
+
+    //Same pattern as the ASSH scan: workers pull chunk indices off a shared counter
+    std::atomic<size_t> next(0);
+    std::atomic<bool> okay(true);
+    auto work = [&](){
+        size_t c;
+        while((c = next.fetch_add(1)) < ccount){
+            const u64 off0 = readLE(idx + (c << 3), 8);
+            const u64 off1 = readLE(idx + ((c + 1) << 3), 8);
+            const size_t dpos = c * csize;
+            const size_t dsize = std::min((size_t)csize, dstlen - dpos);
+            if(!MuenUnzipStream::inflateBuffer(src + off0, static_cast<size_t>(off1 - off0), dst + dpos, dsize, pool)) okay = false;
+        }
+    };
+
+    //This thread pulls chunks too, so the call still finishes if the pool is busy with other jobs
+    size_t tcount = static_cast<size_t>(workers > 0 ? workers : (worker_pool ? worker_pool->getWorkerCount() + 1 : defaultWorkerCount()));
+    if(tcount > ccount) tcount = ccount;
+    std::unique_ptr<MuenWorkerPool> local;
+    if(!worker_pool && tcount > 1){
+        local = std::make_unique<MuenWorkerPool>(static_cast<int>(tcount - 1));
+        worker_pool = local.get();
+    }
+    std::vector<std::future<bool>> helpers;
+    for(size_t t = 1; t < tcount; t++) helpers.push_back(worker_pool->submit([&work](){work(); return true;}));
+    work();
+    for(std::future<bool>& h : helpers) h.wait();
+    return okay;
+}
+
+void MuenParallelUnzipStream::issueChunks(){
+    //The source is only ever read on this thread. Workers just get the compressed bytes.
+    const size_t ccount = getChunkCount();
+    while(next_issue < ccount && next_issue < cur_chunk + lookahead){
+        ChunkJob& job = jobs[next_issue % lookahead];
+        const size_t csize = static_cast<size_t>(chunk_offs[next_issue + 1] - chunk_offs[next_issue]);
+        job.comp.resize(csize);
+        job.comp.resize(input.nextBytes(job.comp.data(), csize)); //Short read fails in the worker
+
+        size_t dsize = decomp_sz - (next_issue * chunk_sz);
+        if(dsize > chunk_sz) dsize = chunk_sz;
+        job.data.resize(dsize);
+
+        ChunkJob* jp = &job;
+        MuenInflatePool* ip = pool;
+        job.done = wpool->submit([jp, ip](){return inflateChunk(jp, ip);});
+        next_issue++;
+    }
+}
+
+const bool MuenParallelUnzipStream::loadChunk(){
+    if(cur_chunk >= getChunkCount()) return false;
+    issueChunks();
+
+    ChunkJob& job = jobs[cur_chunk % lookahead];
+    if(!job.done.valid() || !job.done.get()){
+        failed = true;
+        return false;
+    }
+    out_p0 = job.data.data();
+    out_p1 = out_p0 + job.data.size();
+    cur_loaded = true;
+    return true;
+}
+
+void MuenParallelUnzipStream::drainJobs(){
+    for(ChunkJob& job : jobs){
+        if(job.done.valid()) job.done.wait();
+    }
+}
+
+const int MuenParallelUnzipStream::get(){
+    const ubyte* span = nullptr;
+    if(peekSpan(&span, 1) < 1) return -1;
+    out_p0++;
+    output_ct++;
+    return (int)(*span);
+}
+
+const ubyte MuenParallelUnzipStream::nextByte(){
+    const ubyte* span = nullptr;
+    if(peekSpan(&span, 1) < 1) return 0;
+    out_p0++;
+    output_ct++;
+    return *span;
+}
+
+const size_t MuenParallelUnzipStream::peekSpan(const ubyte** span, const size_t len){
+    if(out_p0 >= out_p1 && !failed && output_ct < decomp_sz){
+        if(cur_loaded){
+            cur_chunk++;
+            cur_loaded = false;
+        }
+        loadChunk();
+    }
+    *span = out_p0;
+
+    const size_t avail = (size_t)(out_p1 - out_p0);
+    return len < avail ? len : avail;
+}
+
+const size_t MuenParallelUnzipStream::nextBytes(ubyte* dst, const size_t len){
+    size_t ct = 0;
+    const ubyte* span = nullptr;
+    while(ct < len){
+        const size_t amt = peekSpan(&span, len - ct);
+        if(amt == 0) break;
+        memcpy(dst + ct, span, amt);
+        out_p0 += amt;
+        output_ct += amt;
+        ct += amt;
+    }
+    return ct;
+}
+
+const size_t MuenParallelUnzipStream::consume(const size_t len){
+    //Skipping whole chunks still inflates them unless the source is seekable
+    if(input.isSeekable() && len > (size_t)(out_p1 - out_p0)){
+        const size_t trg = std::min(output_ct + len, decomp_sz);
+        const size_t start = output_ct;
+        seek(static_cast<streampos>(trg));
+        return output_ct - start;
+    }
+
+    size_t ct = 0;
+    const ubyte* span = nullptr;
+    while(ct < len){
+        const size_t amt = peekSpan(&span, len - ct);
+        if(amt == 0) break;
+        out_p0 += amt;
+        output_ct += amt;
+        ct += amt;
+    }
+    return ct;
+}
+
+const streampos MuenParallelUnzipStream::seek(const streampos pos){
+    if(!is_open || !input.isSeekable()) return SIZE_UNKNOWN;
+    if(pos < 0 || static_cast<size_t>(pos) > decomp_sz) throw InputException("waffleoRai_muengine::MuenParallelUnzipStream::seek", "Seek position is invalid!");
+    const size_t trg = static_cast<size_t>(pos);
+    const size_t c = trg / chunk_sz;
+    const size_t cstart = c * chunk_sz;
+
+    //Inside the chunk already being read
+    if(cur_loaded && c == cur_chunk){
+        out_p0 = jobs[c % lookahead].data.data() + (trg - cstart);
+        output_ct = trg;
+        return pos;
+    }
+
+    //Otherwise restart the pipeline at the target chunk
+    drainJobs();
+    output_ct = trg;
+    cur_chunk = next_issue = c;
+    cur_loaded = false;
+    out_p0 = out_p1 = nullptr;
+    failed = false;
+    if(c < getChunkCount()){
+        input.seek(base_pos + static_cast<std::streamoff>(chunk_offs[c]));
+        if(trg > cstart){
+            if(loadChunk()) out_p0 += (trg - cstart);
+        }
+    }
+    return pos;
+}
+
+void MuenParallelUnzipStream::open(){
+    if(is_open) return;
+    if(!input.isOpen()) input.open();
+
+    base_pos = input.isSeekable() ? input.tell() : static_cast<streampos>(0);
+    output_ct = 0;
+    next_issue = cur_chunk = 0;
+    cur_loaded = false;
+    out_p0 = out_p1 = nullptr;
+    failed = false;
+
+    if(!readIndex()){
+        chunk_offs.clear();
+        is_open = false;
+        return;
+    }
+    jobs = std::vector<ChunkJob>(lookahead);
+    if(!wpool){
+        //Kept for the life of the stream, so reopening or seeking doesn't restart threads
+        own_wpool = std::make_unique<MuenWorkerPool>(lookahead);
+        wpool = own_wpool.get();
+    }
+    is_open = true;
+}
+
+void MuenParallelUnzipStream::close(){
+    if(!is_open) return;
+
+    //Workers hold pointers into the job ring
+    drainJobs();
+    jobs.clear();
+    chunk_offs.clear();
+    out_p0 = out_p1 = nullptr;
+
+    if(delsrc_on_close) delete &input;
+    is_open = false;
+}
+
 const bool MuenZipStream::flushOutput(){
     size_t amt = (size_t)(obuff_p1 - obuff_p0);
     if(amt <= 0) return true; //Nothin to do
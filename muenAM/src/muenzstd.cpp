@@ -0,0 +1,239 @@
+#include "muenzstd.h"
+
+#ifdef MUENAM_USE_ZSTD
+
+using namespace waffleoRai_Utils;
+
+namespace waffleoRai_muengine{
+
+void MuenUnzstdStream::fillInputBuffer(){
+    while(ibuff_p1 < obuffer && !input.streamEnd()){
+        const size_t amt = input.nextBytes(ibuff_p1, (size_t)(obuffer - ibuff_p1));
+        if(amt == 0) break;
+        ibuff_p1 += amt;
+    }
+}
+
+void MuenUnzstdStream::decompNextBlock(){
+    if(ibuff_p0 == ibuff_p1){
+        ibuff_p0 = ibuff_p1 = ibuffer;
+        fillInputBuffer();
+    }
+
+    ZSTD_inBuffer zin = {ibuff_p0, (size_t)(ibuff_p1 - ibuff_p0), 0};
+    ZSTD_outBuffer zout = {obuffer, buffer_sz - (size_t)(obuffer - ibuffer), 0};
+
+    const size_t result = ZSTD_decompressStream(zds, &zout, &zin);
+    if(ZSTD_isError(result)){
+        zerr = result;
+        return;
+    }
+    if(result == 0) z_end_flag = true; //Frame fully decoded and flushed
+    else if(zin.pos == 0 && zout.pos == 0) z_end_flag = true; //No progress: source ran dry before the frame ended
+
+    ibuff_p0 += zin.pos;
+    obuff_p0 = obuffer;
+    obuff_p1 = obuff_p0 + zout.pos;
+}
+
+const bool MuenUnzstdStream::decompressBuffer(const ubyte* src, const size_t srclen, ubyte* dst, const size_t dstlen){
+    //Only the first frame counts. Anything after it (eg. cipher block padding) would otherwise be read as another frame.
+    const size_t framelen = ZSTD_findFrameCompressedSize(src, srclen);
+    if(ZSTD_isError(framelen)) return false;
+    const size_t result = ZSTD_decompress(dst, dstlen, src, framelen);
+    return !ZSTD_isError(result) && (result == dstlen);
+}
+
+const int MuenUnzstdStream::get(){
+    if(streamEnd()) return -1;
+    return (int)nextByte();
+}
+
+const ubyte MuenUnzstdStream::nextByte(){
+    const ubyte* span = nullptr;
+    if(peekSpan(&span, 1) < 1) return 0;
+    obuff_p0++;
+    output_ct++;
+    return *span;
+}
+
+const size_t MuenUnzstdStream::peekSpan(const ubyte** span, const size_t len){
+    //A call can eat input (eg. frame header) without producing output, so keep going until it does or stops
+    while(obuff_p0 >= obuff_p1 && !z_end_flag && output_ct < decomp_sz && !zerr) decompNextBlock();
+    *span = obuff_p0;
+
+    size_t avail = (size_t)(obuff_p1 - obuff_p0);
+    if(avail > decomp_sz - output_ct) avail = decomp_sz - output_ct;
+    return len < avail ? len : avail;
+}
+
+const size_t MuenUnzstdStream::nextBytes(ubyte* dst, const size_t len){
+    size_t ct = 0;
+    const ubyte* span = nullptr;
+    while(ct < len){
+        const size_t amt = peekSpan(&span, len - ct);
+        if(amt == 0) break;
+        memcpy(dst + ct, span, amt);
+        obuff_p0 += amt;
+        output_ct += amt;
+        ct += amt;
+    }
+    return ct;
+}
+
+const size_t MuenUnzstdStream::consume(const size_t len){
+    size_t ct = 0;
+    const ubyte* span = nullptr;
+    while(ct < len){
+        const size_t amt = peekSpan(&span, len - ct);
+        if(amt == 0) break;
+        obuff_p0 += amt;
+        output_ct += amt;
+        ct += amt;
+    }
+    return ct;
+}
+
+const size_t MuenUnzstdStream::remaining() const{
+    return decomp_sz - output_ct;
+}
+
+const bool MuenUnzstdStream::streamEnd() const{
+    if(decomp_sz - output_ct <= 0) return true;
+    if(obuff_p0 < obuff_p1) return false;
+    //The decoder may still be holding output after the source is drained, so only stop once it stalls
+    return z_end_flag || zerr;
+}
+
+void MuenUnzstdStream::open(){
+    if(!input.isOpen()) input.open();
+
+    zds = ZSTD_createDStream();
+    if(!zds){
+        is_open = false;
+        return;
+    }
+
+    //Same split as MuenUnzipStream: 25% input, 75% output
+    ibuffer = (ubyte*)malloc(buffer_sz);
+    ibuff_p0 = ibuff_p1 = ibuffer;
+    obuffer = ibuffer + (buffer_sz >> 2);
+    obuff_p0 = obuff_p1 = obuffer;
+
+    fillInputBuffer();
+    is_open = true;
+}
+
+void MuenUnzstdStream::close(){
+    if(!is_open) return;
+
+    ZSTD_freeDStream(zds);
+    zds = nullptr;
+
+    free(ibuffer);
+    ibuff_p0 = ibuff_p1 = ibuffer = nullptr;
+    obuff_p0 = obuff_p1 = obuffer = nullptr;
+
+    if(delsrc_on_close) delete &input;
+    is_open = false;
+}
+
+/*----- MuenZstdStream -----*/
+
+const bool MuenZstdStream::compressSpan(const ubyte* data, const size_t datlen, const ZSTD_EndDirective mode){
+    ZSTD_inBuffer zin = {data, datlen, 0};
+    while(true){
+        ZSTD_outBuffer zout = {obuffer, obuff_sz, 0};
+        const size_t result = ZSTD_compressStream2(zcs, &zout, &zin, mode);
+        if(ZSTD_isError(result)){
+            zerr = result;
+            return false;
+        }
+        if(zout.pos > 0){
+            if(!output.addBytes(obuffer, zout.pos)) return false;
+        }
+
+        //For ZSTD_e_end, a return of 0 means the frame epilogue has been fully written out
+        if(mode == ZSTD_e_end){
+            if(result == 0) break;
+        }
+        else if(zin.pos >= zin.size) break;
+    }
+    return true;
+}
+
+const bool MuenZstdStream::addByte(ubyte b){
+    *(ibuff_p1++) = b;
+    if(ibuff_p1 >= ibuffer + buffer_sz){
+        const bool res = compressSpan(ibuffer, buffer_sz, ZSTD_e_continue);
+        ibuff_p1 = ibuffer;
+        return res;
+    }
+    return true;
+}
+
+const bool MuenZstdStream::addBytes(const ubyte* data, const size_t datlen){
+    if(!data || datlen <= 0) return false;
+
+    //Large spans go straight to zstd (which has its own window), after anything already staged
+    if(datlen >= MUENZIP_NOCOPY_THRESH){
+        if(ibuff_p1 > ibuffer){
+            if(!compressSpan(ibuffer, (size_t)(ibuff_p1 - ibuffer), ZSTD_e_continue)) return false;
+            ibuff_p1 = ibuffer;
+        }
+        return compressSpan(data, datlen, ZSTD_e_continue);
+    }
+
+    size_t ct = 0;
+    while(ct < datlen){
+        size_t amt = (size_t)((ibuffer + buffer_sz) - ibuff_p1);
+        if(amt > datlen - ct) amt = datlen - ct;
+        memcpy(ibuff_p1, data + ct, amt);
+        ibuff_p1 += amt;
+        ct += amt;
+        if(ibuff_p1 >= ibuffer + buffer_sz){
+            if(!compressSpan(ibuffer, buffer_sz, ZSTD_e_continue)) return false;
+            ibuff_p1 = ibuffer;
+        }
+    }
+    return true;
+}
+
+void MuenZstdStream::open(){
+    if(!output.isOpen()) output.open();
+
+    zcs = ZSTD_createCStream();
+    if(!zcs){
+        is_open = false;
+        return;
+    }
+    ZSTD_CCtx_setParameter(zcs, ZSTD_c_compressionLevel, level);
+
+    ibuffer = (ubyte*)malloc(buffer_sz);
+    ibuff_p1 = ibuffer;
+    obuff_sz = ZSTD_CStreamOutSize();
+    obuffer = (ubyte*)malloc(obuff_sz);
+
+    is_open = true;
+}
+
+void MuenZstdStream::close(){
+    if(!is_open) return;
+
+    //Compress whatever is staged and end the frame
+    compressSpan(ibuffer, (size_t)(ibuff_p1 - ibuffer), ZSTD_e_end);
+
+    ZSTD_freeCStream(zcs);
+    zcs = nullptr;
+
+    free(ibuffer);
+    free(obuffer);
+    ibuffer = ibuff_p1 = obuffer = nullptr;
+
+    if(deltrg_on_close) delete &output;
+    is_open = false;
+}
+
+}
+
+#endif //MUENAM_USE_ZSTD
@@ -0,0 +1,610 @@
+//============================================================================
+// Name        : 
+// Author      : Blythe Hospelhorn
+// Version     :
+//============================================================================
+
+#include "muenaes.h"
+#include "muenzip.h"
+#include "muenam_formats.h"
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <vector>
+#include <random>
+#include <mutex>
+#include <shared_mutex>
+#include <future>
+#include <memory>
+#include <optional>
+#include <zlib.h>
+
+//The AssetManager test fills in the path table and card map directly
+#define private public
+#include "muenam.h"
+#undef private
+
+using namespace waffleoRai_Utils;
+using namespace waffleoRai_muengine;
+using std::cout;
+
+const char* aesKernelName(const int kernel) {
+	switch (kernel) {
+	case AES_KERNEL_REFERENCE: return "reference";
+	case AES_KERNEL_TTABLE: return "t-table";
+	case AES_KERNEL_AESNI: return "aes-ni";
+	case AES_KERNEL_ARMCE: return "armv8-ce";
+	}
+	return "unknown";
+}
+
+const bool testAESVectors() {
+	//FIPS-197 Appendix C.1
+	ubyte key[16];
+	ubyte pt[16];
+	ubyte ct[16];
+	ubyte out[16];
+	const ubyte expected[16] = { 0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a };
+	for (int i = 0; i < 16; i++) {
+		key[i] = static_cast<ubyte>(i);
+		pt[i] = static_cast<ubyte>((i << 4) | i);
+	}
+
+	aes_key128_t* aeskey = aes_gen_key_128(key);
+	const int defkernel = aes_get_kernel();
+	bool okay = true;
+	const int kernels[4] = { AES_KERNEL_REFERENCE, AES_KERNEL_TTABLE, AES_KERNEL_AESNI, AES_KERNEL_ARMCE };
+	for (int k : kernels) {
+		if (!aes_kernel_supported(k)) continue;
+		aes_set_kernel(k);
+		rijndael_enc(aeskey, pt, ct);
+		rijndael_dec(aeskey, ct, out);
+		const bool encokay = memcmp(ct, expected, 16) == 0;
+		const bool decokay = memcmp(out, pt, 16) == 0;
+		cout << "AES-128 FIPS-197 vector (" << aesKernelName(k) << "): encrypt " << (encokay ? "ok" : "FAIL") << ", decrypt " << (decokay ? "ok" : "FAIL") << "\n";
+		okay = okay && encokay && decokay;
+	}
+	free(aeskey);
+	aes_set_kernel(defkernel);
+	return okay;
+}
+
+const bool testAESCBCBlocks() {
+	//SP 800-38A F.2.1, then multi-block CBC against a per-block chain for every kernel.
+	//	67 blocks split into calls that don't line up with the 8 (AES-NI) or 4 (ARMv8) block lanes.
+	const ubyte sp_key[16] = { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+	const ubyte sp_pt[64] = {
+		0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+		0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+		0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+		0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10 };
+	const ubyte sp_ct[64] = {
+		0x76, 0x49, 0xab, 0xac, 0x81, 0x19, 0xb2, 0x46, 0xce, 0xe9, 0x8e, 0x9b, 0x12, 0xe9, 0x19, 0x7d,
+		0x50, 0x86, 0xcb, 0x9b, 0x50, 0x72, 0x19, 0xee, 0x95, 0xdb, 0x11, 0x3a, 0x91, 0x76, 0x78, 0xb2,
+		0x73, 0xbe, 0xd6, 0xb8, 0xe3, 0xc1, 0x74, 0x3b, 0x71, 0x16, 0xe6, 0x9e, 0x22, 0x22, 0x95, 0x16,
+		0x3f, 0xf1, 0xca, 0xa1, 0x68, 0x1f, 0xac, 0x09, 0x12, 0x0e, 0xca, 0x30, 0x75, 0x86, 0xe1, 0xa7 };
+	const size_t splits[6] = { 1, 3, 9, 13, 5, 36 };
+	const size_t bcount = 67;
+
+	ubyte key[16];
+	ubyte iv0[16];
+	memcpy(key, sp_key, 16);
+	for (int i = 0; i < 16; i++) iv0[i] = static_cast<ubyte>(i);
+	std::vector<ubyte> ct(bcount << 4);
+	for (size_t i = 0; i < ct.size(); i++) ct[i] = static_cast<ubyte>((i * 167) ^ (i >> 3));
+
+	aes_key128_t* aeskey = aes_gen_key_128(key);
+	const int defkernel = aes_get_kernel();
+	bool okay = true;
+	const int kernels[4] = { AES_KERNEL_REFERENCE, AES_KERNEL_TTABLE, AES_KERNEL_AESNI, AES_KERNEL_ARMCE };
+	for (int k : kernels) {
+		if (!aes_kernel_supported(k)) continue;
+		aes_set_kernel(k);
+		ubyte iv[16];
+		aes_state128_t state;
+		memset(&state, 0, sizeof(aes_state128_t));
+		state.key = aeskey;
+
+		//Known answer
+		ubyte spbuff[64];
+		memcpy(iv, iv0, 16);
+		state.vec = iv;
+		aes_encblocks_cbc128(sp_pt, spbuff, 4, &state);
+		bool kaokay = memcmp(spbuff, sp_ct, 64) == 0;
+		memcpy(iv, iv0, 16);
+		state.vec = iv;
+		aes_decblocks_cbc128(spbuff, spbuff, 4, &state);
+		kaokay = kaokay && memcmp(spbuff, sp_pt, 64) == 0;
+
+		//Per-block chain
+		std::vector<ubyte> expected(ct.size());
+		memcpy(iv, iv0, 16);
+		state.vec = iv;
+		for (size_t b = 0; b < bcount; b++) aes_decblock_cbc128(&ct[b << 4], &expected[b << 4], &state);
+
+		//One call, out of place
+		std::vector<ubyte> out(ct.size());
+		memcpy(iv, iv0, 16);
+		state.vec = iv;
+		aes_decblocks_cbc128(ct.data(), out.data(), bcount, &state);
+		bool decokay = out == expected;
+
+		//Several calls, in place
+		out = ct;
+		memcpy(iv, iv0, 16);
+		state.vec = iv;
+		size_t b = 0;
+		for (size_t n : splits) {
+			aes_decblocks_cbc128(&out[b << 4], &out[b << 4], n, &state);
+			b += n;
+		}
+		decokay = decokay && out == expected;
+
+		//Round trip, in place
+		memcpy(iv, iv0, 16);
+		state.vec = iv;
+		b = 0;
+		for (size_t n : splits) {
+			aes_encblocks_cbc128(&out[b << 4], &out[b << 4], n, &state);
+			b += n;
+		}
+		const bool encokay = out == ct;
+
+		cout << "AES-128 CBC (" << aesKernelName(k) << "): SP 800-38A " << (kaokay ? "ok" : "FAIL") << ", multi-block decrypt " << (decokay ? "ok" : "FAIL") << ", round trip " << (encokay ? "ok" : "FAIL") << "\n";
+		okay = okay && kaokay && decokay && encokay;
+	}
+	free(aeskey);
+	aes_set_kernel(defkernel);
+	return okay;
+}
+
+const bool testDecryptStream() {
+	//MuenDecryptStream over several window sizes, reading in odd sized pieces then seeking. With the plain size set, padding is cut off.
+	std::mt19937 rng(0x64656373);
+	ubyte key[16];
+	ubyte iv[16];
+	for (int i = 0; i < 16; i++) {
+		key[i] = static_cast<ubyte>(i);
+		iv[i] = static_cast<ubyte>(i * 3);
+	}
+	aes_key128_t* aeskey = aes_gen_key_128(key);
+
+	bool okay = true;
+	for (size_t size : { 0, 1, 15, 16, 17, 1000, 40000 }) {
+		vector<ubyte> plain(size);
+		for (ubyte& b : plain) b = static_cast<ubyte>(rng());
+		vector<ubyte> padded = plain;
+		padded.resize((size + 16) & ~static_cast<size_t>(15), 0);
+		vector<ubyte> ct(padded.size());
+		ubyte enciv[16];
+		memcpy(enciv, iv, 16);
+		aes_enc_cbc128(padded.data(), ct.data(), padded.size(), key, enciv);
+
+		for (size_t win : { 16, 64, 0x4000 }) {
+			MemInputStreamer input(ct.data(), ct.size());
+			input.open();
+			MuenDecryptStream dec(input, aeskey, iv, win);
+			dec.setPlainSize(size);
+			dec.open();
+
+			vector<ubyte> out(size + 64);
+			bool caseokay = dec.remaining() == size;
+			size_t got = 0;
+			while (!dec.streamEnd() && got < out.size()) {
+				if (rng() & 1) out[got++] = dec.nextByte();
+				else got += dec.nextBytes(out.data() + got, std::min<size_t>(rng() % 100 + 1, out.size() - got));
+			}
+			caseokay = caseokay && got == size && (size == 0 || memcmp(out.data(), plain.data(), size) == 0);
+			caseokay = caseokay && dec.streamEnd() && dec.remaining() == 0;
+
+			//Random access, landing anywhere inside a block
+			for (int i = 0; i < 50 && size > 0; i++) {
+				const size_t pos = rng() % (size + 1);
+				dec.seek(pos);
+				if (static_cast<size_t>(dec.tell()) != pos || dec.remaining() != size - pos) caseokay = false;
+				const size_t amt = rng() % 100;
+				got = 0;
+				if (rng() & 1) got = dec.nextBytes(out.data(), amt);
+				else while (got < amt && !dec.streamEnd()) out[got++] = dec.nextByte();
+				if (got != std::min(amt, size - pos) || memcmp(out.data(), plain.data() + pos, got) != 0) caseokay = false;
+			}
+			dec.close();
+			okay = okay && caseokay;
+		}
+	}
+	free(aeskey);
+	cout << "AES-128 CBC stream: " << (okay ? "ok" : "FAIL") << "\n";
+	return okay;
+}
+
+const bool testDexorSeek() {
+	//MuenDexorStream over a source that was already partway in when it was opened
+	std::mt19937 rng(0x64786f72);
+	ubyte key[16];
+	for (int i = 0; i < 16; i++) key[i] = static_cast<ubyte>(rng());
+	vector<ubyte> plain(1000);
+	for (ubyte& b : plain) b = static_cast<ubyte>(rng());
+
+	bool okay = true;
+	vector<ubyte> out(plain.size());
+	for (size_t prefix : { 0, 5, 16, 21 }) {
+		vector<ubyte> raw(prefix, 0xee);
+		for (size_t i = 0; i < plain.size(); i++) raw.push_back(plain[i] ^ key[i & 0xf]);
+		MemInputStreamer input(raw.data(), raw.size());
+		input.open();
+		input.consume(prefix);
+		MuenDexorStream dexor(input, key);
+		dexor.open();
+		if (dexor.tell() != 0) okay = false;
+		for (int i = 0; i < 200; i++) {
+			const size_t pos = rng() % plain.size();
+			if (static_cast<size_t>(dexor.seek(pos)) != pos || static_cast<size_t>(dexor.tell()) != pos) okay = false;
+			const size_t amt = std::min<size_t>(rng() % 70, plain.size() - pos);
+			if (rng() & 1) {
+				if (dexor.nextBytes(out.data(), amt) != amt) okay = false;
+			}
+			else for (size_t j = 0; j < amt; j++) out[j] = dexor.nextByte();
+			if (memcmp(out.data(), plain.data() + pos, amt) != 0) okay = false;
+		}
+	}
+	cout << "XOR stream seek: " << (okay ? "ok" : "FAIL") << "\n";
+	return okay;
+}
+
+static void putLE(vector<ubyte>& dst, const u64 val, const int bytes) {
+	for (int i = 0; i < bytes; i++) dst.push_back(static_cast<ubyte>(val >> (i << 3)));
+}
+
+const vector<ubyte> deflateWhole(const ubyte* src, const size_t len) {
+	uLongf clen = compressBound(static_cast<uLong>(len));
+	vector<ubyte> out(clen);
+	compress2(out.data(), &clen, src, static_cast<uLong>(len), 7);
+	out.resize(clen);
+	return out;
+}
+
+const vector<ubyte> deflateChunked(const vector<ubyte>& plain, const u32 chunk_size) {
+	//Chunk size [4], chunk count [4], chunk offsets (count + 1) [8 each], then a zlib stream per chunk
+	const size_t ccount = (plain.size() + chunk_size - 1) / chunk_size;
+	vector<vector<ubyte>> chunks(ccount);
+	for (size_t i = 0; i < ccount; i++) {
+		const size_t off = i * chunk_size;
+		chunks[i] = deflateWhole(plain.data() + off, std::min<size_t>(chunk_size, plain.size() - off));
+	}
+	vector<ubyte> out;
+	putLE(out, chunk_size, 4);
+	putLE(out, ccount, 4);
+	u64 off = 8 + ((ccount + 1) << 3);
+	for (size_t i = 0; i <= ccount; i++) {
+		putLE(out, off, 8);
+		if (i < ccount) off += chunks[i].size();
+	}
+	for (vector<ubyte>& c : chunks) out.insert(out.end(), c.begin(), c.end());
+	return out;
+}
+
+const vector<ubyte> testPayload(const size_t size) {
+	vector<ubyte> plain(size);
+	for (size_t i = 0; i < size; i++) plain[i] = static_cast<ubyte>((i * 7) ^ (i >> 8) ^ (i % 97 == 0 ? i >> 3 : 0));
+	return plain;
+}
+
+const vector<ubyte> packResource(const vector<ubyte>& plain, const u16 flags, const u64 instance, const ubyte* mkey) {
+	//Encodes plain the way the packager would for this card. mkey is null if packages aren't encrypted.
+	vector<ubyte> payload;
+	if ((flags & ASSH_ENTRY_FLAG_CHUNKED) != 0) payload = deflateChunked(plain, MUENZIP_DEFO_CHUNK_SIZE);
+	else if ((flags & ASSH_ENTRY_COMP_MASK) != 0) payload = deflateWhole(plain.data(), plain.size());
+	else payload = plain;
+
+	ubyte tgi[16];
+	muen_tgi_bytes(1, 0, instance, tgi);
+	if ((flags & ASSH_ENTRY_FLAG_XOR) != 0) {
+		for (size_t i = 0; i < payload.size(); i++) payload[i] ^= tgi[i & 0xf];
+	}
+	if (mkey) {
+		payload.resize((payload.size() + 15) & ~static_cast<size_t>(15), 0);
+		ubyte rkey[16];
+		ubyte iv[16];
+		memcpy(rkey, mkey, 16);
+		aesutil_xor128(rkey, tgi, rkey);
+		memcpy(iv, "muEngine", 8);
+		memcpy(iv + 8, "TESTGAME", 8);
+		aes_enc_cbc128(payload.data(), payload.data(), payload.size(), rkey, iv);
+	}
+	return payload;
+}
+
+const bool testParallelUnzip() {
+	//Chunked DEFLATE through MuenParallelUnzipStream: mixed reads to the end, then random seeks
+	const vector<ubyte> plain = testPayload(1000003);
+	std::mt19937 rng(0x70756e7a);
+	bool okay = true;
+	for (u32 csize : { 0x1000u, 0x10000u }) {
+		const vector<ubyte> payload = deflateChunked(plain, csize);
+		for (int workers : { 1, 3, 0 }) {
+			MemInputStreamer input(payload.data(), payload.size());
+			input.open();
+			MuenParallelUnzipStream unzip(input, plain.size(), workers);
+			unzip.open();
+			if (!unzip.isOpen()) {
+				okay = false;
+				continue;
+			}
+
+			vector<ubyte> out;
+			while (!unzip.streamEnd()) {
+				const size_t amt = rng() % 9000 + 1;
+				switch (rng() % 4) {
+				case 0: out.push_back(static_cast<ubyte>(unzip.get())); break;
+				case 1: out.push_back(unzip.nextByte()); break;
+				case 2: {
+					const size_t pos = out.size();
+					out.resize(pos + amt);
+					out.resize(pos + unzip.nextBytes(out.data() + pos, amt));
+					break;
+				}
+				default: {
+					const ubyte* span = nullptr;
+					const size_t got = unzip.peekSpan(&span, amt);
+					out.insert(out.end(), span, span + got);
+					unzip.consume(got);
+					break;
+				}
+				}
+			}
+			bool rtokay = out == plain && unzip.get() == -1;
+
+			bool seekokay = true;
+			vector<ubyte> buff(20000);
+			for (int i = 0; i < 500; i++) {
+				const size_t pos = rng() % (plain.size() + 1);
+				const size_t amt = rng() % buff.size();
+				if (unzip.seek(pos) != static_cast<streampos>(pos)) seekokay = false;
+				const size_t got = unzip.nextBytes(buff.data(), amt);
+				if (got != std::min(amt, plain.size() - pos) || memcmp(buff.data(), plain.data() + pos, got) != 0) seekokay = false;
+				if (unzip.tell() != static_cast<streampos>(pos + got)) seekokay = false;
+			}
+			unzip.close();
+
+			vector<ubyte> whole(plain.size() + 1);
+			const bool bufokay = MuenParallelUnzipStream::inflateBuffer(payload.data(), payload.size(), whole.data(), plain.size(), workers) && memcmp(whole.data(), plain.data(), plain.size()) == 0
+				&& !MuenParallelUnzipStream::inflateBuffer(payload.data(), payload.size(), whole.data(), plain.size() + 1, workers);
+
+			cout << "Chunked inflate (chunk 0x" << std::hex << csize << std::dec << ", " << workers << " workers): round trip " << (rtokay ? "ok" : "FAIL") << ", seek " << (seekokay ? "ok" : "FAIL") << ", buffer " << (bufokay ? "ok" : "FAIL") << "\n";
+			okay = okay && rtokay && seekokay && bufokay;
+		}
+
+		//Two streams on one shared worker pool, read in turns
+		MuenWorkerPool wpool(2);
+		MemInputStreamer input_a(payload.data(), payload.size());
+		MemInputStreamer input_b(payload.data(), payload.size());
+		input_a.open();
+		input_b.open();
+		MuenParallelUnzipStream unzip_a(input_a, plain.size(), 0, nullptr, &wpool);
+		MuenParallelUnzipStream unzip_b(input_b, plain.size(), 0, nullptr, &wpool);
+		unzip_a.open();
+		unzip_b.open();
+		vector<ubyte> out_a(plain.size());
+		vector<ubyte> out_b(plain.size());
+		size_t got_a = 0;
+		size_t got_b = 0;
+		unzip_b.seek(plain.size() >> 1);
+		while (!unzip_a.streamEnd() || !unzip_b.streamEnd()) {
+			got_a += unzip_a.nextBytes(out_a.data() + got_a, rng() % 30000 + 1);
+			got_b += unzip_b.nextBytes(out_b.data() + got_b, rng() % 30000 + 1);
+		}
+		const bool sharedokay = got_a == plain.size() && out_a == plain && got_b == plain.size() - (plain.size() >> 1) && memcmp(out_b.data(), plain.data() + (plain.size() >> 1), got_b) == 0;
+		cout << "Chunked inflate (chunk 0x" << std::hex << csize << std::dec << ", shared pool): " << (sharedokay ? "ok" : "FAIL") << "\n";
+		okay = okay && sharedokay;
+	}
+
+	//Index that doesn't match the size shouldn't open
+	vector<ubyte> bad(16, 0);
+	MemInputStreamer input(bad.data(), bad.size());
+	input.open();
+	MuenParallelUnzipStream unzip(input, 100);
+	unzip.open();
+	const bool rejokay = !unzip.isOpen();
+	cout << "Chunked inflate bad index: " << (rejokay ? "ok" : "FAIL") << "\n";
+	return okay && rejokay;
+}
+
+const bool testInflatePool() {
+	//Lots of MuenUnzipStreams sharing one MuenInflatePool. Some are dropped partway, so the next one has to get a clean context.
+	std::mt19937 rng(0x706f6f6c);
+	MuenInflatePool pool(4, 0x8000);
+
+	MuenInflateContext* ctx = pool.acquire(0x1000);
+	pool.release(ctx);
+	bool reuseokay = pool.acquire(0x800) == ctx && ctx->buffer_sz == 0x1000;
+	pool.release(ctx);
+	ctx = pool.acquire(0x10000);
+	pool.release(ctx);
+	ctx = pool.acquire(16);
+	reuseokay = reuseokay && ctx->buffer_sz == 16;
+	pool.release(ctx);
+
+	bool streamokay = true;
+	bool bufokay = true;
+	vector<ubyte> out_a(50000);
+	vector<ubyte> out(50000);
+	for (int i = 0; i < 300; i++) {
+		const vector<ubyte> plain = testPayload(rng() % 50000);
+		const vector<ubyte> payload = deflateWhole(plain.data(), plain.size());
+		MemInputStreamer input_a(payload.data(), payload.size());
+		MemInputStreamer input_b(payload.data(), payload.size());
+		input_a.open();
+		input_b.open();
+		const size_t bufsize = (rng() & 1) ? 0x1000 : 0x10000;
+		MuenUnzipStream unzip_a(input_a, bufsize, plain.size(), &pool);
+		MuenUnzipStream unzip_b(input_b, bufsize, plain.size(), &pool);
+		unzip_a.open();
+		unzip_b.open();
+		const size_t stop = (i % 3 == 0) ? rng() % (plain.size() + 1) : plain.size();
+		size_t got_a = 0;
+		size_t got_b = 0;
+		while (got_a < stop || got_b < plain.size()) {
+			if (got_a < stop) got_a += unzip_a.nextBytes(out_a.data() + got_a, std::min<size_t>(rng() % 3000 + 1, stop - got_a));
+			const size_t amt = unzip_b.nextBytes(out.data() + got_b, rng() % 3000 + 1);
+			if (memcmp(out.data() + got_b, plain.data() + got_b, amt) != 0) streamokay = false;
+			got_b += amt;
+			if (unzip_b.streamEnd() && got_b < plain.size()) break;
+		}
+		streamokay = streamokay && got_a == stop && memcmp(out_a.data(), plain.data(), stop) == 0 && got_b == plain.size() && unzip_b.streamEnd();
+		unzip_a.close();
+		unzip_b.close();
+
+		//One-shot inflate on the same pool. Like decompSize on the stream, a shorter dst just takes the front.
+		vector<ubyte> whole(plain.size() + 1);
+		if (!MuenUnzipStream::inflateBuffer(payload.data(), payload.size(), whole.data(), plain.size(), &pool) || memcmp(whole.data(), plain.data(), plain.size()) != 0) bufokay = false;
+		if (!MuenUnzipStream::inflateBuffer(payload.data(), payload.size(), whole.data(), plain.size() >> 1, &pool) || memcmp(whole.data(), plain.data(), plain.size() >> 1) != 0) bufokay = false;
+		if (MuenUnzipStream::inflateBuffer(payload.data(), payload.size(), whole.data(), plain.size() + 1, &pool)) bufokay = false;
+	}
+	cout << "Inflate pool: reuse " << (reuseokay ? "ok" : "FAIL") << ", streams " << (streamokay ? "ok" : "FAIL") << ", buffer " << (bufokay ? "ok" : "FAIL") << "\n";
+	return reuseokay && streamokay && bufokay;
+}
+
+const bool testResourceStreams(const std::filesystem::path& dir) {
+	//Each package encoding through openResource and loadResourceInto, with and without AES. Every resource is opened a few times, so pooled chains get reused.
+	const vector<ubyte> plain = testPayload(3000017);
+	const u16 comp_deflate = ASSH_COMP_DEFLATE << ASSH_ENTRY_COMP_SHIFT;
+	const vector<u16> flags = { 0, ASSH_ENTRY_FLAG_XOR, comp_deflate, comp_deflate | ASSH_ENTRY_FLAG_XOR, comp_deflate | ASSH_ENTRY_FLAG_CHUNKED | ASSH_ENTRY_FLAG_XOR };
+	ubyte mkey[16];
+	for (int i = 0; i < 16; i++) mkey[i] = static_cast<ubyte>(i * 5 + 1);
+	std::filesystem::create_directories(dir);
+
+	bool okay = true;
+	vector<ubyte> out(plain.size() + 100);
+	for (int enc = 0; enc < 2; enc++) {
+		AssetManager am(0x100000, true);
+		am.cloadmdl = ALL_ON_BOOT;
+		am.encrypt_assh = false;
+		am.encrypt_all = enc != 0;
+		memcpy(am.aes_key, mkey, 16);
+		memcpy(am.gamecode, "TESTGAME", 8);
+		am.setRootPath(UnicodeString(dir.u8string().c_str()));
+		const string pkgname = "test" + std::to_string(enc) + ".assp";
+		const path* pkgpath = &am.pathtbl.getPathAtIndex(am.pathtbl.addPath(path(pkgname)));
+
+		vector<ubyte> pkg(0x30, 0);
+		for (u64 r = 0; r < flags.size(); r++) {
+			const vector<ubyte> payload = packResource(plain, flags[r], r, enc ? mkey : nullptr);
+			ResourceCard* card = am.res_map.addCard(ResourceKey(1, 0, r));
+			card->filepath = pkgpath;
+			card->offset = pkg.size();
+			card->rawSize = payload.size();
+			card->decompSize = plain.size();
+			card->misc_flags = flags[r];
+			card->compressed = (flags[r] & ASSH_ENTRY_COMP_MASK) != 0;
+			pkg.insert(pkg.end(), payload.begin(), payload.end());
+		}
+		std::ofstream pkgout(dir / pkgname, std::ios::binary);
+		pkgout.write(reinterpret_cast<const char*>(pkg.data()), pkg.size());
+		pkgout.close();
+
+		for (u64 r = 0; r < flags.size(); r++) {
+			bool streamokay = true;
+			for (int rep = 0; rep < 3; rep++) {
+				std::fill(out.begin(), out.end(), 0);
+				ResourceReader reader = am.openResource(ResourceKey(1, 0, r));
+				size_t got = reader->nextBytes(out.data(), 37);
+				got += reader->nextBytes(out.data() + got, out.size() - got);
+				streamokay = streamokay && got == plain.size() && reader->streamEnd() && memcmp(out.data(), plain.data(), got) == 0;
+				if ((flags[r] & ASSH_ENTRY_FLAG_CHUNKED) != 0) {
+					reader->getSource().seek(1234567);
+					streamokay = streamokay && reader->nextBytes(out.data(), 64) == 64 && memcmp(out.data(), plain.data() + 1234567, 64) == 0;
+				}
+			}
+
+			std::fill(out.begin(), out.end(), 0);
+			const size_t got = am.loadResourceInto(ResourceKey(1, 0, r), out.data(), out.size());
+			const bool loadokay = got == plain.size() && memcmp(out.data(), plain.data(), got) == 0;
+			cout << "Resource stream (" << (enc ? "aes, " : "") << "flags 0x" << std::hex << flags[r] << std::dec << "): stream " << (streamokay ? "ok" : "FAIL") << ", load " << (loadokay ? "ok" : "FAIL") << "\n";
+			okay = okay && streamokay && loadokay;
+		}
+
+		//Two open at once need separate chains, and closed chains go back to the pool
+		bool poolokay = true;
+		{
+			ResourceReader a = am.openResource(ResourceKey(1, 0, 0));
+			ResourceReader b = am.openResource(ResourceKey(1, 0, 3));
+			poolokay = a->nextByte() == plain[0] && b->nextByte() == plain[0];
+			poolokay = poolokay && a->nextByte() == plain[1];
+		}
+		const size_t pooled = am.stream_pool.size();
+		{
+			ResourceReader a = am.openResource(ResourceKey(1, 0, 2));
+			poolokay = poolokay && a->nextByte() == plain[0];
+		}
+		poolokay = poolokay && pooled == 2 && am.stream_pool.size() == pooled;
+
+		bool shortokay = false;
+		try { am.loadResourceInto(ResourceKey(1, 0, 2), out.data(), plain.size() - 1); }
+		catch (InputException&) { shortokay = true; }
+		bool missingokay = false;
+		try { am.loadResourceInto(ResourceKey(1, 0, 99), out.data(), out.size()); }
+		catch (NoResourceCardException&) { missingokay = true; }
+		cout << "Resource stream pool (" << (enc ? "aes" : "plain") << "): reuse " << (poolokay ? "ok" : "FAIL") << ", short buffer " << (shortokay ? "ok" : "FAIL") << ", missing card " << (missingokay ? "ok" : "FAIL") << "\n";
+		okay = okay && poolokay && shortokay && missingokay;
+	}
+	std::filesystem::remove_all(dir);
+	return okay;
+}
+
+void benchAES(const size_t bytes) {
+	//CBC decrypt throughput for each kernel, over the same buffer
+	std::vector<ubyte> src(bytes);
+	std::vector<ubyte> dst(bytes);
+	for (size_t i = 0; i < bytes; i++) src[i] = static_cast<ubyte>(i * 131);
+	ubyte key[16];
+	ubyte iv[16];
+	for (int i = 0; i < 16; i++) key[i] = static_cast<ubyte>(0xa5 ^ i);
+	aes_key128_t* aeskey = aes_gen_key_128(key);
+	const int defkernel = aes_get_kernel();
+	const double mb = static_cast<double>(bytes) / (1024.0 * 1024.0);
+
+	const int kernels[4] = { AES_KERNEL_REFERENCE, AES_KERNEL_TTABLE, AES_KERNEL_AESNI, AES_KERNEL_ARMCE };
+	for (int k : kernels) {
+		if (!aes_kernel_supported(k)) continue;
+		aes_set_kernel(k);
+
+		memset(iv, 0, 16);
+		aes_state128_t state;
+		memset(&state, 0, sizeof(aes_state128_t));
+		state.key = aeskey;
+		state.vec = iv;
+		auto t0 = std::chrono::steady_clock::now();
+		for (size_t off = 0; off < bytes; off += 16) aes_decblock_cbc128(&src[off], &dst[off], &state);
+		auto t1 = std::chrono::steady_clock::now();
+		double secs = std::chrono::duration<double>(t1 - t0).count();
+		printf("AES-128 CBC decrypt (%s, per block): %.1f MB/s\n", aesKernelName(k), mb / secs);
+
+		memset(iv, 0, 16);
+		state.vec = iv;
+		t0 = std::chrono::steady_clock::now();
+		aes_decblocks_cbc128(src.data(), dst.data(), bytes >> 4, &state);
+		t1 = std::chrono::steady_clock::now();
+		secs = std::chrono::duration<double>(t1 - t0).count();
+		printf("AES-128 CBC decrypt (%s, multi-block): %.1f MB/s\n", aesKernelName(k), mb / secs);
+	}
+	free(aeskey);
+	aes_set_kernel(defkernel);
+}
+
+int main(void)
+{
+	try {
+		if (!testAESVectors()) return 1;
+		if (!testAESCBCBlocks()) return 1;
+		if (!testDecryptStream()) return 1;
+		if (!testDexorSeek()) return 1;
+		if (!testParallelUnzip()) return 1;
+		if (!testInflatePool()) return 1;
+		if (!testResourceStreams(std::filesystem::temp_directory_path() / "muenam_test")) return 1;
+		benchAES(0x1000000);
+	}
+	catch (exception& e) { cout << "Uncaught exception: \n" << e.what() << "\n"; return 1; }
+
+	return 0;
+}